@@ -16,29 +16,75 @@ namespace modelMethod{
  * @brief Constructor
  */
 Method::Method(MethodConstructionData const*){
-  modelData.load(ProgramContext::get().args.modelFile);
+  modelData.load(ProgramContext::get().args.modelFile,ProgramContext::get().args.compressTextures);
   model = modelData.getModel();
 
+  mem.settings = ProgramContext::get().args.gpuSettings;
   prepareModel(mem,commandBuffer,model);
+  frameMem[0] = mem;
+  frameMem[1] = mem;
 }
 
 
+/**
+ * @brief This function sets the frame and the scene uniforms of gpu memory
+ *
+ * @param m gpu memory
+ * @param frame framebuffer
+ * @param sceneParam scene parameters
+ */
+void setupFrame(GPUMemory&m,Frame&frame,SceneParam const&sceneParam){
+  m.framebuffer = frame;
+  m.uniforms[0].m4 = sceneParam.proj * sceneParam.view;
+  m.uniforms[1].v3 = sceneParam.light;
+  m.uniforms[2].v3 = sceneParam.camera;
+}
+
+/**
+ * @brief This function adds statistics of a finished frame to the total ones and clears them
+ *
+ * @param total statistics of all frames
+ * @param frame statistics of one frame
+ */
+void mergeStatistics(GPUStatistics&total,GPUStatistics&frame){
+  total.vertexCacheLookups      += frame.vertexCacheLookups     ;
+  total.vertexCacheHits         += frame.vertexCacheHits        ;
+  total.vertexQueueFullWaits    += frame.vertexQueueFullWaits   ;
+  total.vertexQueueEmptyWaits   += frame.vertexQueueEmptyWaits  ;
+  total.triangleQueueFullWaits  += frame.triangleQueueFullWaits ;
+  total.triangleQueueEmptyWaits += frame.triangleQueueEmptyWaits;
+  frame = GPUStatistics();
+}
+
 /**
  * @brief This function is called every frame and should render a model
  *
- * @param proj projection matrix
- * @param view view matrix
- * @param light light position
- * @param camera camera position
+ * @param frame framebuffer
+ * @param sceneParam scene parameters
  */
 void Method::onDraw(Frame&frame,SceneParam const&sceneParam){
-  mem.framebuffer = frame;
-  mem.uniforms[0].m4 = sceneParam.proj * sceneParam.view;
-  mem.uniforms[1].v3 = sceneParam.light;
-  mem.uniforms[2].v3 = sceneParam.camera;
+  setupFrame(mem,frame,sceneParam);
   gpu_execute(mem,commandBuffer);
 }
 
+/**
+ * @brief This function is called every frame by the application, it submits the model to the gpu and returns
+ * Statistics of a frame slot are added to mem.statistics when the slot is reused,
+ * the application waits for the previous frame before it submits the next one, so the slot is finished by then.
+ * mem.statistics therefore lacks the last two frames in flight.
+ *
+ * @param frame framebuffer
+ * @param sceneParam scene parameters
+ *
+ * @return fence of the frame
+ */
+GPUFence Method::onDrawAsync(Frame&frame,SceneParam const&sceneParam){
+  auto&m = frameMem[frameID++%2];
+  mergeStatistics(mem.statistics,m.statistics);
+  setupFrame(m,frame,sceneParam);
+  return gpu_execute_async(m,commandBuffer);
+}
+
 EntryPoint main = [](){registerMethod<Method>("izg13 model loader");};
 
 }
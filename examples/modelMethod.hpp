@@ -16,10 +16,13 @@ class Method: public ::Method{
      */
     virtual ~Method(){};
     virtual void onDraw(Frame&frame,SceneParam const&sceneParam) override;
+    virtual GPUFence onDrawAsync(Frame&frame,SceneParam const&sceneParam) override;
     ModelData     modelData;
     Model         model;
     CommandBuffer commandBuffer;
     GPUMemory     mem;
+    GPUMemory     frameMem[2];///< memory of frames in flight, the next frame is set up while the gpu renders the previous one
+    uint32_t      frameID = 0;
 };
 
 }
@@ -95,18 +95,87 @@ void fragmentShader(OutFragment&outFragment,InFragment const&inFragment,ShaderIn
   outFragment.gl_FragColor = glm::vec4(color,1.f);
 }
 
+/**
+ * @brief This function represents batched fragment shader of phong method.
+ * It computes the same colors as fragmentShader, every loop runs over all fragments of the packet,
+ * so the compiler can vectorize it.
+ *
+ * @param outPacket output fragments
+ * @param inPacket input fragments
+ * @param uniforms uniform variables
+ */
+void fragmentPacketShader(OutFragmentPacket&outPacket,InFragmentPacket const&inPacket,ShaderInterface const&si){
+  uint32_t const n = fragmentPacketSize;
+  auto const& light          = si.uniforms[2].v3;
+  auto const& cameraPosition = si.uniforms[3].v3;
+  auto const& vpos           = inPacket.attributes[0].v;
+  auto const& vnor           = inPacket.attributes[1].v;
+
+  float diffuseFactor[n],specularFactor[n],t[n],stripe[n];
+
+  for(uint32_t i=0;i<n;++i){
+    float nx = vnor[0][i],ny = vnor[1][i],nz = vnor[2][i];
+    float nl = 1.f/std::sqrt(nx*nx+ny*ny+nz*nz);
+    nx*=nl;ny*=nl;nz*=nl;
+
+    float lx = light.x-vpos[0][i],ly = light.y-vpos[1][i],lz = light.z-vpos[2][i];
+    float ll = 1.f/std::sqrt(lx*lx+ly*ly+lz*lz);
+    lx*=ll;ly*=ll;lz*=ll;
+
+    float vx = cameraPosition.x-vpos[0][i],vy = cameraPosition.y-vpos[1][i],vz = cameraPosition.z-vpos[2][i];
+    float vl = 1.f/std::sqrt(vx*vx+vy*vy+vz*vz);
+    vx*=vl;vy*=vl;vz*=vl;
+
+    // r = -reflect(v,n)
+    float nv = 2.f*(nx*vx+ny*vy+nz*vz);
+    float rx = nv*nx-vx,ry = nv*ny-vy,rz = nv*nz-vz;
+
+    diffuseFactor [i] = glm::max(lx*nx+ly*ny+lz*nz,0.f);
+    specularFactor[i] = glm::max(rx*lx+ry*ly+rz*lz,0.f);
+    t             [i] = glm::max(ny,0.f)*glm::max(ny,0.f);
+  }
+
+  float const shininess = 40.f;
+  for(uint32_t i=0;i<n;++i)
+    specularFactor[i] = powf(specularFactor[i],shininess);
+
+  float const nofStripes = 10;
+  float const factor = 1.f / nofStripes * 2.f;
+  for(uint32_t i=0;i<n;++i){
+    float x = vpos[0][i]+glm::sin(vpos[1][i]*10.f)*.1f;
+    stripe[i] = (x-factor*glm::floor(x/factor))/factor > 0.5f ? 1.f : 0.f;
+  }
+
+  for(uint32_t i=0;i<n;++i){
+    // mix(mix(vec3(0,.5,0),vec3(1,1,0),stripe),vec3(1),t)
+    float r = stripe[i];
+    float g = .5f+.5f*stripe[i];
+    float b = 0.f;
+    r += (1.f-r)*t[i];
+    g += (1.f-g)*t[i];
+    b += (1.f-b)*t[i];
+    outPacket.gl_FragColor[0][i] = glm::min(r*diffuseFactor[i]+specularFactor[i],1.f);
+    outPacket.gl_FragColor[1][i] = glm::min(g*diffuseFactor[i]+specularFactor[i],1.f);
+    outPacket.gl_FragColor[2][i] = glm::min(b*diffuseFactor[i]+specularFactor[i],1.f);
+    outPacket.gl_FragColor[3][i] = 1.f;
+  }
+}
+
 /**
  * @brief Constructoro f phong method
  */
 Method::Method(MethodConstructionData const*){
+  mem.settings = ProgramContext::get().args.gpuSettings;
   mem.buffers[0].data = (void const*)bunnyVertices;
   mem.buffers[0].size = sizeof(bunnyVertices);
   mem.buffers[1].data = (void const*)bunnyIndices;
   mem.buffers[1].size = sizeof(bunnyIndices);
   mem.programs[0].vertexShader   = vertexShader;
   mem.programs[0].fragmentShader = fragmentShader;
+  mem.programs[0].fragmentPacketShader = fragmentPacketShader;
   mem.programs[0].vs2fs[0]       = AttributeType::VEC3;
   mem.programs[0].vs2fs[1]       = AttributeType::VEC3;
+  mem.programs[0].earlyDepthTest = true;
 
   VertexArray vao;
   vao.vertexAttrib[0].bufferID   = 0                  ;
@@ -42,7 +42,9 @@ Application::Application(int32_t width,int32_t height):Window(width,height,"izgP
 /**
  * @brief Destructor
  */
-Application::~Application(){}
+Application::~Application(){
+  if(pendingFrame.valid())pendingFrame.wait();
+}
 
     
 /**
@@ -69,7 +71,8 @@ void Application::createMethodIfItDoesNotExist(){
   if(mr.method)return;
   int w,h;
   SDL_GetWindowSize(getWindow(),&w,&h);
-  framebuffer = std::make_shared<Framebuffer>(w,h);
+  framebuffer     = std::make_shared<Framebuffer>(w,h);
+  backFramebuffer = nullptr;
 
   mr.method = mr.methodFactories[mr.selectedMethod](&*mr.methodConstructData[mr.selectedMethod]);
   SDL_SetWindowTitle(getWindow(),mr.methodName.at(mr.selectedMethod).c_str());
@@ -87,10 +90,25 @@ void Application::idle(){
   sceneParam.camera = glm::vec3(glm::inverse(sceneParam.view)*glm::vec4(0.f,0.f,0.f,1.f));
   sceneParam.light  = light;
 
-  auto frame = framebuffer->getFrame();
-  mr.method->onDraw(frame,sceneParam);
+  // a frame that is still rendered occupies framebuffer, the next one goes to the back buffer
+  // that is allocated only for methods that actually return unfinished fences
+  bool const drawIntoBack = pendingFrame.valid();
+  if(drawIntoBack && !backFramebuffer)
+    backFramebuffer = std::make_shared<Framebuffer>(framebuffer->width,framebuffer->height);
 
-  swap();
+  auto frame = (drawIntoBack?backFramebuffer:framebuffer)->getFrame();
+  auto fence = mr.method->onDrawAsync(frame,sceneParam);
+
+  if(drawIntoBack){
+    // previous frame is presented while the gpu renders this one
+    finishFrame();
+    std::swap(framebuffer,backFramebuffer);
+  }
+  pendingFrame = fence;
+
+  // synchronous methods are presented immediately
+  if(pendingFrame.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    finishFrame();
 }
 
 void Application::resize(SDL_Event const&event){
@@ -100,7 +118,9 @@ void Application::resize(SDL_Event const&event){
   auto const aspect = static_cast<float>(width) / static_cast<float>(height);
   perspectiveCamera.setAspect(aspect);
   if(mr.method){
-    framebuffer->resize(event.window.data1,event.window.data2);
+    finishFrame();
+    framebuffer    ->resize(event.window.data1,event.window.data2);
+    if(backFramebuffer)backFramebuffer->resize(event.window.data1,event.window.data2);
   }
   reInitRenderer();
 }
@@ -139,6 +159,7 @@ void Application::nextMethod(uint32_t key){
   auto const nofMethods = mr.methodFactories.size();
   mr.selectedMethod++;
   if(mr.selectedMethod >= nofMethods)mr.selectedMethod=0;
+  finishFrame();
   mr.method = nullptr;
 }
 
@@ -148,6 +169,7 @@ void Application::prevMethod(uint32_t key){
   auto const nofMethods = mr.methodFactories.size();
   if(mr.selectedMethod > 0)mr.selectedMethod--;
   else mr.selectedMethod = nofMethods-1;
+  finishFrame();
   mr.method = nullptr;
 }
 
@@ -179,6 +201,16 @@ void Application::swap(){
   copyToSDLSurface(surface,frame,w,h);
 }
 
+/**
+ * @brief This function waits for the frame that is rendered by the gpu and presents it
+ */
+void Application::finishFrame(){
+  if(!pendingFrame.valid())return;
+  pendingFrame.wait();
+  pendingFrame = GPUFence();
+  swap();
+}
+
 void copyToSDLSurface(SDL_Surface*surface,uint8_t const*const frame,uint32_t width,uint32_t height){
   uint32_t const bitsPerByte    = 8;
   uint32_t const swizzleTable[] = {
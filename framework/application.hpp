@@ -43,6 +43,7 @@ class Application: protected Window{
     void quit      (uint32_t key);
     void createMethodIfItDoesNotExist();
     void swap();
+    void finishFrame();
 
 
     basicCamera::OrbitCamera       orbitCamera                                  ;
@@ -54,7 +55,9 @@ class Application: protected Window{
 
     Timer<float>                   timer                                        ;
 
-    std::shared_ptr<Framebuffer>framebuffer;///< framebuffer
+    std::shared_ptr<Framebuffer>framebuffer    ;///< framebuffer that is presented
+    std::shared_ptr<Framebuffer>backFramebuffer;///< framebuffer the next frame is drawn into while framebuffer is rendered (async methods only)
+    GPUFence                    pendingFrame   ;///< fence of frame in framebuffer that is not presented yet
 };
 
 /**
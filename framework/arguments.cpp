@@ -17,6 +17,14 @@ Arguments::Arguments(int argc,char const*argv[]){
   mseThreshold        = args->getf32   ("--mse"       ,40,"mse threshold for image to image test");
   testToBreak         = args->geti32   ("--breakTest" ,-1,"this will forcefully break test with this number");
 
+  gpuSettings.mode       = args->isPresent("--tiled"  ,"gpu bins triangles into screen tiles and rasterizes tiles in parallel") ? ExecutionMode::TILED : ExecutionMode::SERIAL;
+  if(args->isPresent("--pipelined","gpu runs vertex stage, primitive stage and rasterization concurrently"))gpuSettings.mode = ExecutionMode::PIPELINED;
+  gpuSettings.nofThreads = args->getu32   ("--threads",0,"number of gpu worker threads (0 - one per hardware thread)");
+  gpuSettings.vertexCache= args->isPresent("--vertex-cache","indexed draws transform every unique vertex only once");
+  gpuSettings.blockedFramebuffer = args->isPresent("--blocked-framebuffer","gpu renders into 8x8 pixel blocks and resolves the frame to rows at the end");
+  gpuSettings.fastClear          = args->isPresent("--fast-clear","clear is written into 8x8 pixel blocks when draws touch them for the first time");
+  compressTextures               = args->isPresent("--compressed-textures","textures of models are encoded into BC1/BC3 blocks at load and decoded when sampled");
+
 
   auto printHelp  = args->isPresent("-h"    ,"prints help");
   printHelp |= args->isPresent("--help","prints help");
@@ -11,6 +11,8 @@
 #include <iostream>
 #include <string>
 
+#include <student/fwd.hpp>
+
 #ifndef CMAKE_ROOT_DIR
 /**
  * location of project
@@ -47,5 +49,7 @@ class Arguments{
   bool     upToTest; ///< run tests up to selected test
   float    mseThreshold;///< threshold for image test
   int32_t  testToBreak;///< if you want to forcefully break test, set it to test id
+  GPUSettings gpuSettings;///< settings of the gpu used by rendering methods
+  bool     compressTextures;///< textures of models are block compressed at load
 };
 
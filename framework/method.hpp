@@ -48,6 +48,22 @@ class Method{
      * @param camera camera position
      */
     virtual void onDraw(Frame&frame,SceneParam const&sceneParam) = 0;
+    /**
+     * @brief This function is called every frame instead of onDraw by the application.
+     * Methods that submit their work by gpu_execute_async override it,
+     * the next frame is then prepared while the gpu renders this one.
+     *
+     * @param frame framebuffer, it is not presented until the fence is signaled
+     * @param sceneParam scene parameters
+     *
+     * @return fence of the frame
+     */
+    virtual GPUFence onDrawAsync(Frame&frame,SceneParam const&sceneParam){
+      onDraw(frame,sceneParam);
+      std::promise<void>done;
+      done.set_value();
+      return done.get_future().share();
+    }
     /**
      * @brief This function is called on update
      *
@@ -4,6 +4,7 @@
 #include <glm/gtx/quaternion.hpp>
 
 #include <framework/model.hpp>
+#include <student/gpu.hpp>
 #include <libs/tiny_gltf/tiny_gltf.h>
 
 namespace tests{
@@ -39,18 +40,53 @@ std::string accesstorType2Str(int i){
 class ModelDataImpl{
   public:
     ModelDataImpl();
-    void load(std::string const&fileName);
+    void load(std::string const&fileName,bool compressTextures);
     ~ModelDataImpl();
     Model getModel();
     bool ret = false;
     tinygltf::Model model;
     tinygltf::TinyGLTF loader;
+    std::vector<Texture>              levels;///< textures of images with mipmap levels and tiled or compressed texels, they are generated once per load
+    std::vector<std::vector<uint32_t>>tiles ;
 };
 
 ModelDataImpl::ModelDataImpl(){
 }
 
-void ModelDataImpl::load(std::string const&fileName){
+/**
+ * @brief This function converts glTF filter to texture filter
+ * NEAREST and NEAREST_MIPMAP_* filter texels of a level by NEAREST, the rest (including undefined) by LINEAR.
+ * The nearest mipmap level is always chosen, mipmap part of the minification filter is ignored.
+ *
+ * @param filter glTF filter
+ *
+ * @return texture filter
+ */
+TextureFilter toTextureFilter(int filter){
+  switch(filter){
+    case TINYGLTF_TEXTURE_FILTER_NEAREST               :
+    case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_NEAREST:
+    case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_LINEAR :return TextureFilter::NEAREST;
+    default                                            :return TextureFilter::LINEAR ;
+  }
+}
+
+/**
+ * @brief This function converts glTF wrap mode to texture wrap mode
+ *
+ * @param wrap glTF wrap mode
+ *
+ * @return texture wrap mode, REPEAT by default
+ */
+TextureWrap toTextureWrap(int wrap){
+  switch(wrap){
+    case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE  :return TextureWrap::CLAMP_TO_EDGE  ;
+    case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:return TextureWrap::MIRRORED_REPEAT;
+    default                                   :return TextureWrap::REPEAT         ;
+  }
+}
+
+void ModelDataImpl::load(std::string const&fileName,bool compressTextures){
   std::string err;
   std::string warn;
   if(fileName.find(".glb")==fileName.length()-4)
@@ -61,6 +97,33 @@ void ModelDataImpl::load(std::string const&fileName){
 
   if(!ret)
     std::cerr << "model: " << fileName << "was not loaded" << std::endl;
+
+  levels.clear();
+  tiles .clear();
+  for(auto&img:model.images){
+    Texture tex;
+    tex.width    = img.width;
+    tex.height   = img.height;
+    tex.channels = img.component;
+    tex.data     = img.image.data();
+    tiles.push_back(compressTextures?compress_texture(tex):tile_texture(tex));
+
+    // sample_texture reads only the tiles or blocks, the decoded image is released
+    tex.data = nullptr;
+    std::vector<unsigned char>().swap(img.image);
+    levels.push_back(tex);
+  }
+
+  // sampler of the first texture that uses the image
+  for(auto it=model.textures.rbegin();it!=model.textures.rend();++it){
+    if(it->source<0||(size_t)it->source>=levels.size()||it->sampler<0||(size_t)it->sampler>=model.samplers.size())continue;
+    auto const&sampler = model.samplers.at(it->sampler);
+    auto&tex = levels.at(it->source);
+    tex.magFilter = toTextureFilter(sampler.magFilter);
+    tex.minFilter = toTextureFilter(sampler.minFilter);
+    tex.wrapS     = toTextureWrap  (sampler.wrapS    );
+    tex.wrapT     = toTextureWrap  (sampler.wrapT    );
+  }
 }
 
 ModelDataImpl::~ModelDataImpl(){
@@ -121,16 +184,7 @@ Model ModelDataImpl::getModel(){
   }
   //std::cerr << "loaded nodes" << std::endl;
 
-  for(auto const&img:model.images){
-    res.textures.push_back({});
-    auto&tex = res.textures.back();
-    //std::cerr << "w: " << img.width << " h: " << img.height << " c: " << img.component << " \"" << img.name << "\"" << std::endl;
-    //std::cerr << "size: " << img.image.size() << std::endl;
-    tex.width    = img.width;
-    tex.height   = img.height;
-    tex.channels = img.component;
-    tex.data     = img.image.data();
-  }
+  res.textures = levels;
 
   for(auto const&buf:model.buffers){
     Buffer buffer;
@@ -272,8 +326,8 @@ Model ModelDataImpl::getModel(){
   return res;
 }
 
-void ModelData::load(std::string const&fileName){
-  impl->load(fileName);
+void ModelData::load(std::string const&fileName,bool compressTextures){
+  impl->load(fileName,compressTextures);
 }
 
 ModelData::ModelData(){
@@ -10,7 +10,7 @@ class ModelDataImpl;
 class ModelData{
   public:
     ModelData();
-    void load(std::string const&fileName);
+    void load(std::string const&fileName,bool compressTextures = false);
     ~ModelData();
     Model getModel();
   private:
@@ -57,7 +57,24 @@ glm::vec4 multiplyMatrixVector(const glm::mat4& matrix, glm::vec4& vector)
 	return result;
 }
 
-DrawCommand createDrawCommand(Mesh& mesh)
+/**
+ * @brief This function returns true if all fragments of the mesh have alpha 1, blending does not change them.
+ */
+bool isOpaque(Model const& model, Mesh const& mesh)
+{
+	if (mesh.diffuseTexture == -1)
+		return mesh.diffuseColor.a >= 1.f;
+
+	// textures without alpha channel are read with alpha 1
+	if ((size_t)mesh.diffuseTexture >= model.textures.size())
+		return false;
+	Texture const& texture = model.textures[mesh.diffuseTexture];
+	if (texture.texels)
+		return texture.format == TextureFormat::BC1 || (texture.format == TextureFormat::RGBA8 && texture.channels < 4);
+	return texture.data && texture.channels < 4;
+}
+
+DrawCommand createDrawCommand(Mesh& mesh, Model const& model)
 {
 	VertexArray vao;
 	vao.indexBufferID = mesh.indexBufferID;
@@ -69,6 +86,7 @@ DrawCommand createDrawCommand(Mesh& mesh)
 
 	DrawCommand draw;
 	draw.backfaceCulling = !mesh.doubleSided;
+	draw.blendMode = isOpaque(model, mesh) ? BlendMode::DISABLED : BlendMode::ALPHA;
 	draw.nofVertices = mesh.nofIndices;
 	draw.programID = 0;
 	draw.vao = vao;
@@ -87,7 +105,7 @@ void prepareNode(GPUMemory& mem, CommandBuffer& commandBuffer, Model const& mode
 		Mesh mesh = model.meshes[node.mesh];
 
 		// create draw command
-		DrawCommand draw = createDrawCommand(mesh);
+		DrawCommand draw = createDrawCommand(mesh, model);
 		if (commandBuffer.nofCommands + 1 < commandBuffer.maxCommands)
 		{
 			commandBuffer.commands[commandBuffer.nofCommands].type = CommandType::DRAW;
@@ -137,6 +155,10 @@ void prepareModel(GPUMemory& mem, CommandBuffer& commandBuffer, Model const& mod
 
 	mem.programs[0].fragmentShader = drawModel_fragmentShader;
 	mem.programs[0].vertexShader = drawModel_vertexShader;
+	mem.programs[0].vertexPacketShader = drawModel_vertexPacketShader;
+	mem.programs[0].earlyDepthTest = true;
+	// texture coordinates select mipmap levels
+	mem.programs[0].derivativeAttribute = 2;
 
 	// adding first clear command
 	ClearCommand clear;
@@ -183,6 +205,43 @@ void drawModel_vertexShader(OutVertex& outVertex, InVertex const& inVertex, Shad
 }
 //! [drawModel_vs]
 
+// Transforms vertices of a packet by matrix, w is the same for all of them.
+// Operations are ordered like in multiplyMatrixVector, so the results are identical.
+static void transformLanes(const glm::mat4& matrix, float const (*in)[vertexPacketSize], float w, float (*out)[vertexPacketSize], int nofRows)
+{
+	for (int r = 0; r < nofRows; ++r)
+		for (uint32_t i = 0; i < vertexPacketSize; ++i)
+			out[r][i] = in[0][i] * matrix[0][r] + in[1][i] * matrix[1][r] + in[2][i] * matrix[2][r] + w * matrix[3][r];
+}
+
+/**
+ * @brief This function represents batched version of drawModel_vertexShader.
+ *
+ * @param outPacket output vertices
+ * @param inPacket input vertices
+ * @param si shader interface
+ */
+ //! [drawModel_vsPacket]
+void drawModel_vertexPacketShader(OutVertexPacket& outPacket, InVertexPacket const& inPacket, ShaderInterface const& si)
+{
+	int index = 10 + inPacket.gl_DrawID * 5;
+
+	glm::mat4 transformationMatrix;
+	multiplyMatrices(si.uniforms[index].m4, si.uniforms[0].m4, transformationMatrix);
+
+	transformLanes(si.uniforms[index].m4, inPacket.attributes[0].v, 1.f, outPacket.attributes[0].v, 3);
+	transformLanes(si.uniforms[index + 1].m4, inPacket.attributes[1].v, 0.f, outPacket.attributes[1].v, 3);
+	transformLanes(transformationMatrix, inPacket.attributes[0].v, 1.f, outPacket.gl_Position, 4);
+
+	for (uint32_t i = 0; i < vertexPacketSize; ++i)
+	{
+		outPacket.attributes[2].v[0][i] = inPacket.attributes[2].v[0][i];
+		outPacket.attributes[2].v[1][i] = inPacket.attributes[2].v[1][i];
+		outPacket.attributes[3].u[0][i] = inPacket.gl_DrawID;
+	}
+}
+//! [drawModel_vsPacket]
+
 /**
  * @brief This functionrepresents fragment shader of texture rendering method.
  *
@@ -207,7 +266,7 @@ void drawModel_fragmentShader(OutFragment& outFragment, InFragment const& inFrag
 	if (textureID == -1)
 		dC = si.uniforms[index + 2].v4;
 	else
-		dC = read_texture(si.textures[textureID], inFragment.attributes[2].v2);
+		dC = sample_texture(si.textures[textureID], inFragment.attributes[2].v2, glm::vec2(inFragment.dFdx), glm::vec2(inFragment.dFdy));
 
 	if (si.uniforms[index + 4].v1 == 1.f &&
 		glm::dot(normal, si.uniforms[2].v3 - inFragment.attributes[0].v3) < 0.0)
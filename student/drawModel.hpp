@@ -14,4 +14,6 @@ void prepareModel(GPUMemory&mem,CommandBuffer&commandBuffer,Model const&model);
 
 void drawModel_vertexShader(OutVertex&outVertex,InVertex const&inVertex,ShaderInterface const&si);
 
+void drawModel_vertexPacketShader(OutVertexPacket&outPacket,InVertexPacket const&inPacket,ShaderInterface const&si);
+
 void drawModel_fragmentShader(OutFragment&outFragment,InFragment const&inFragment,ShaderInterface const&si);
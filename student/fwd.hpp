@@ -14,16 +14,57 @@
 //#define MAKE_STUDENT_RELEASE
 
 uint32_t const maxAttributes = 4;///< maximum number of vertex/fragment attributes
+uint32_t const maxTextureLevels = 16;///< maximum number of mipmap levels of a texture including the base level
+
+/**
+ * @brief This enum represents filtering of texels read by sample_texture.
+ */
+//! [TextureFilter]
+enum class TextureFilter{
+  NEAREST = 0, ///< the nearest texel
+  LINEAR  = 1, ///< bilinear interpolation of 2x2 nearest texels
+};
+//! [TextureFilter]
+
+/**
+ * @brief This enum represents how sample_texture reads texture coordinates outside of [0,1].
+ */
+//! [TextureWrap]
+enum class TextureWrap{
+  REPEAT          = 0, ///< texture repeats
+  CLAMP_TO_EDGE   = 1, ///< edge texels are repeated
+  MIRRORED_REPEAT = 2, ///< texture repeats mirrored every other time
+};
+//! [TextureWrap]
+
+/**
+ * @brief This enum represents format of Texture::texels, they are stored in 4x4 texel blocks.
+ */
+//! [TextureFormat]
+enum class TextureFormat{
+  RGBA8 = 0, ///< 16 texels of 32 bits per block, see tile_texture
+  BC1   = 1, ///< 64-bit block of two RGB565 colors and 2-bit indices, alpha is 1, see compress_texture
+  BC3   = 2, ///< 64-bit block of two alphas and 3-bit indices followed by BC1 color block, see compress_texture
+};
+//! [TextureFormat]
 
 /**
  * @brief This struct represent a texture
  */
 //! [Texture]
 struct Texture{
-  uint8_t const* data     = nullptr;///< pointer to data
+  uint8_t const* data     = nullptr;///< pointer to row-major data, it can be nullptr if texels are set, levels created by generate_mipmaps follow the base level
   uint32_t       width    = 0      ;///< width of the texture
   uint32_t       height   = 0      ;///< height of the texture
   uint32_t       channels = 3      ;///< number of channels of the texture
+  uint32_t       nofLevels = 1     ;///< number of mipmap levels including the base level
+  uint32_t const* texels = nullptr  ;///< optional texels of all levels in 4x4 blocks created by tile_texture or compress_texture, sample_texture reads them
+  TextureFormat  format   = TextureFormat::RGBA8 ;///< format of texels
+  uint32_t       levelOffsets[maxTextureLevels] = {};///< offset of the first block of every level in texels (in 32-bit words)
+  TextureFilter  magFilter = TextureFilter::LINEAR;///< filtering of sample_texture if a pixel is smaller than a texel
+  TextureFilter  minFilter = TextureFilter::LINEAR;///< filtering of sample_texture within the mipmap level if a pixel is larger than a texel
+  TextureWrap    wrapS     = TextureWrap::REPEAT  ;///< wrapping of sample_texture along u
+  TextureWrap    wrapT     = TextureWrap::REPEAT  ;///< wrapping of sample_texture along v
 };
 //! [Texture]
 
@@ -89,6 +130,8 @@ struct OutVertex{
 struct InFragment{
   Attribute attributes[maxAttributes]               ; ///< fragment attributes
   glm::vec4 gl_FragCoord              = glm::vec4(1); ///< fragment coordinates
+  glm::vec4 dFdx                      = glm::vec4(0); ///< screen space x derivative of attribute Program::derivativeAttribute
+  glm::vec4 dFdy                      = glm::vec4(0); ///< screen space y derivative of attribute Program::derivativeAttribute
 };
 //! [InFragment]
 
@@ -101,6 +144,69 @@ struct OutFragment{
 };
 //! [OutFragment]
 
+uint32_t const fragmentPacketSize = 8; ///< number of fragments processed by one call of batched fragment shader
+
+/**
+ * @brief This union represents one attribute of all vertices/fragments of a packet.
+ * Components are stored as structure of arrays, so shader code can process all fragments at once.
+ */
+//! [AttributeLanes]
+union AttributeLanes{
+  AttributeLanes(){}
+  alignas(32) float    v[4][fragmentPacketSize]; ///< float components, v[component][fragment]
+  alignas(32) uint32_t u[4][fragmentPacketSize]; ///< unsigned int components, u[component][fragment]
+};
+//! [AttributeLanes]
+
+/**
+ * @brief This struct represents input packet of batched fragment shader.
+ * Fragments of one packet are neighbouring pixels in one row of one triangle.
+ * Only components of attributes enabled in Program::vs2fs are valid.
+ */
+//! [InFragmentPacket]
+struct InFragmentPacket{
+  AttributeLanes    attributes[maxAttributes]          ; ///< fragment attributes
+  alignas(32) float gl_FragCoord[4][fragmentPacketSize]; ///< fragment coordinates, gl_FragCoord[component][fragment]
+  alignas(32) float dFdx[4][fragmentPacketSize]        ; ///< x derivatives of Program::derivativeAttribute, valid only if it is set
+  alignas(32) float dFdy[4][fragmentPacketSize]        ; ///< y derivatives of Program::derivativeAttribute, valid only if it is set
+  uint32_t          coverage = 0                       ; ///< bit i is set if fragment i is valid
+};
+//! [InFragmentPacket]
+
+/**
+ * @brief This struct represents output packet of batched fragment shader.
+ */
+//! [OutFragmentPacket]
+struct OutFragmentPacket{
+  alignas(32) float gl_FragColor[4][fragmentPacketSize]; ///< fragment colors, gl_FragColor[component][fragment]
+};
+//! [OutFragmentPacket]
+
+uint32_t const vertexPacketSize = fragmentPacketSize; ///< number of vertices processed by one call of batched vertex shader
+
+/**
+ * @brief This struct represents input packet of batched vertex shader.
+ * Vertices of one packet belong to the same draw, only first nofVertices of them are valid.
+ */
+//! [InVertexPacket]
+struct InVertexPacket{
+  AttributeLanes attributes[maxAttributes]          ; ///< vertex attributes
+  uint32_t       gl_VertexID[vertexPacketSize] = {}; ///< vertex ids
+  uint32_t       gl_DrawID                     = 0 ; ///< draw id
+  uint32_t       nofVertices                   = 0 ; ///< number of valid vertices
+};
+//! [InVertexPacket]
+
+/**
+ * @brief This struct represents output packet of batched vertex shader.
+ */
+//! [OutVertexPacket]
+struct OutVertexPacket{
+  AttributeLanes    attributes[maxAttributes]        ; ///< vertex attributes
+  alignas(32) float gl_Position[4][vertexPacketSize] ; ///< clip space positions, gl_Position[component][vertex]
+};
+//! [OutVertexPacket]
+
 /**
  * @brief This union represents one uniform variable.
  */
@@ -177,6 +283,34 @@ using FragmentShader = void(*)(
     ShaderInterface const&si         );
 //! [FragmentShader]
 
+/**
+ * @brief Function type for batched vertex shader
+ *
+ * @param outPacket output vertices, only first inPacket.nofVertices are used
+ * @param inPacket input vertices
+ * @param uniforms uniform variables
+ */
+//! [VertexPacketShader]
+using VertexPacketShader = void(*)(
+    OutVertexPacket          &outPacket,
+    InVertexPacket      const&inPacket ,
+    ShaderInterface     const&si       );
+//! [VertexPacketShader]
+
+/**
+ * @brief Function type for batched fragment shader
+ *
+ * @param outPacket output fragments, only covered fragments are used
+ * @param inPacket input fragments with coverage mask
+ * @param uniforms uniform variables
+ */
+//! [FragmentPacketShader]
+using FragmentPacketShader = void(*)(
+    OutFragmentPacket          &outPacket,
+    InFragmentPacket      const&inPacket ,
+    ShaderInterface       const&si       );
+//! [FragmentPacketShader]
+
 /**
  * @brief This struct describes location of one vertex attribute.
  */
@@ -211,7 +345,11 @@ struct VertexArray{
 struct Program{
   VertexShader   vertexShader   = nullptr; ///< vertex shader
   FragmentShader fragmentShader = nullptr; ///< fragment shader
+  VertexPacketShader   vertexPacketShader   = nullptr; ///< optional batched vertex shader, it is used instead of vertexShader
+  FragmentPacketShader fragmentPacketShader = nullptr; ///< optional batched fragment shader, it is used instead of fragmentShader
   AttributeType  vs2fs[maxAttributes] = {AttributeType::EMPTY}; ///< which attributes are interpolated from vertex shader to fragment shader
+  bool           earlyDepthTest = false  ; ///< depth is tested before fragment shader, occluded fragments do not run it (shader must not have side effects)
+  int32_t        derivativeAttribute = -1; ///< float attribute whose screen space derivatives are passed to fragment shader (-1 - none), e.g. texture coordinates for mipmapping
 };
 //! [Program]
 
@@ -241,6 +379,46 @@ struct Buffer{
 };
 //! [Buffer]
 
+/**
+ * @brief This enum represents the way the gpu processes draw commands.
+ */
+//! [ExecutionMode]
+enum class ExecutionMode{
+  SERIAL    = 0, ///< whole pipeline runs in submission order on the calling thread
+  TILED     = 1, ///< vertices are transformed in parallel, triangles are binned into screen tiles and tiles are rasterized in parallel
+  PIPELINED = 2, ///< vertex stage, primitive stage and rasterization run concurrently on their own threads connected by queues
+};
+//! [ExecutionMode]
+
+/**
+ * @brief This struct represents settings of the gpu.
+ * Default values select the serial reference pipeline.
+ */
+//! [GPUSettings]
+struct GPUSettings{
+  ExecutionMode mode               = ExecutionMode::SERIAL; ///< execution mode of draw commands
+  uint32_t      nofThreads         = 0                    ; ///< number of worker threads (0 - one per hardware thread)
+  bool          vertexCache        = false                ; ///< indexed draws run vertex shader only once per unique gl_VertexID
+  bool          blockedFramebuffer = false                ; ///< color and depth are rendered in 8x8 pixel blocks and resolved to rows at the end of gpu_execute
+  bool          fastClear          = false                ; ///< clear only marks 8x8 blocks, pixels are written by the first draw touching them or at the end of gpu_execute
+};
+//! [GPUSettings]
+
+/**
+ * @brief This struct represents counters collected by the gpu.
+ * Counters are accumulated over all gpu_execute calls, assign {} to reset them.
+ */
+//! [GPUStatistics]
+struct GPUStatistics{
+  uint64_t vertexCacheLookups      = 0; ///< number of indexed vertices looked up in post-transform vertex cache
+  uint64_t vertexCacheHits         = 0; ///< number of lookups that reused already transformed vertex
+  uint64_t vertexQueueFullWaits    = 0; ///< pipelined mode: vertex stage waited for the primitive stage
+  uint64_t vertexQueueEmptyWaits   = 0; ///< pipelined mode: primitive stage waited for the vertex stage
+  uint64_t triangleQueueFullWaits  = 0; ///< pipelined mode: primitive stage waited for the rasterizer
+  uint64_t triangleQueueEmptyWaits = 0; ///< pipelined mode: rasterizer waited for the primitive stage
+};
+//! [GPUStatistics]
+
 /**
  * @brief This structure represents memory on GPU
  */
@@ -250,11 +428,13 @@ struct GPUMemory{
   uint32_t const static maxTextures = 1000 ; ///< maximal number of textures
   uint32_t const static maxBuffers  = 100  ; ///< maximal number of buffers
   uint32_t const static maxPrograms = 100  ; ///< maximal number of programs
-  Buffer  buffers [maxBuffers ]; ///< array of all buffers
-  Texture textures[maxTextures]; ///< array of all textures
-  Uniform uniforms[maxUniforms]; ///< array of all uniform variables
-  Program programs[maxPrograms]; ///< array of all programs
-  Frame   framebuffer;           ///< framebuffer - output of rendering
+  Buffer        buffers [maxBuffers ]; ///< array of all buffers
+  Texture       textures[maxTextures]; ///< array of all textures
+  Uniform       uniforms[maxUniforms]; ///< array of all uniform variables
+  Program       programs[maxPrograms]; ///< array of all programs
+  Frame         framebuffer;           ///< framebuffer - output of rendering
+  GPUSettings   settings   ;           ///< settings of the gpu
+  GPUStatistics statistics ;           ///< counters collected during rendering
 };
 //! [GPUMemory]
 
@@ -274,6 +454,27 @@ struct ClearCommand{
 };
 //! [ClearCommand]
 
+/**
+ * @brief This enum represents winding of front facing triangles in screen space.
+ */
+//! [FrontFace]
+enum class FrontFace{
+  CCW = 0, ///< counter-clockwise triangles are front facing
+  CW  = 1, ///< clockwise triangles are front facing
+};
+//! [FrontFace]
+
+/**
+ * @brief This enum represents the way fragment colors are combined with colors in the framebuffer.
+ */
+//! [BlendMode]
+enum class BlendMode{
+  ALPHA         = 0, ///< rgb = fragment*alpha + framebuffer*(1-alpha)
+  DISABLED      = 1, ///< fragment color replaces the framebuffer, the framebuffer is not read
+  PREMULTIPLIED = 2, ///< fragment color is already multiplied by alpha: rgba = fragment + framebuffer*(1-alpha)
+};
+//! [BlendMode]
+
 /**
  * @brief This structure represents draw command.
  * Draw command issues draw operation on the GPU.
@@ -283,6 +484,8 @@ struct DrawCommand{
   int32_t     programID       = -1   ; ///< selected shader program - id
   uint32_t    nofVertices     = 0    ; ///< number of vertices to draw
   bool        backfaceCulling = false; ///< is culling of backfacing triangles enabled?
+  FrontFace   frontFace       = FrontFace::CCW; ///< winding of front facing triangles
+  BlendMode   blendMode       = BlendMode::ALPHA; ///< blending of fragments with the framebuffer
   VertexArray vao                    ; ///< active vertex array (input/ triangles)
 };
 //! [DrawCommand]
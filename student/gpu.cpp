@@ -6,574 +6,3011 @@
  */
 
 #include <student/gpu.hpp>
+#include <student/threadPool.hpp>
+#include <student/spscQueue.hpp>
+#include <cmath>
+#include <algorithm>
 #include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <emmintrin.h>
 
 struct Triangle {
     OutVertex points[3];
 };
 
-void readAttributes(Attribute& vertexAtrrib, GPUMemory& mem, VertexAttrib& attrib, uint32_t vertexId)
-{
-    if (attrib.type == AttributeType::EMPTY) return;
-
-    const void* attribBuffer = mem.buffers[attrib.bufferID].data;
-    unsigned char* bytePtr = (unsigned char*)attribBuffer;
-    bytePtr += attrib.offset + attrib.stride * vertexId;
+using IndexDecoder = uint32_t (*)(uint8_t const* indices, uint32_t shaderInvocation);
+using AttributeReader = void (*)(Attribute& attribute, uint8_t const* bytePtr);
 
-    switch (attrib.type)
-    {
-    case AttributeType::UVEC2:
-        vertexAtrrib.u2 = *((glm::uvec2*)(bytePtr));
-        break;
-    case AttributeType::UVEC3:
-        vertexAtrrib.u3 = *((glm::uvec3*)(bytePtr));
-        break;
-    case AttributeType::UVEC4:
-        vertexAtrrib.u4 = *((glm::uvec4*)(bytePtr));
-        break;
-    case AttributeType::VEC4:
-        vertexAtrrib.v4 = *((glm::vec4*)(bytePtr));
-        break;
-    case AttributeType::VEC3:
-        vertexAtrrib.v3 = *((glm::vec3*)(bytePtr));
-        break;
-    case AttributeType::VEC2:
-        vertexAtrrib.v2 = *((glm::vec2*)(bytePtr));
-        break;
-    case AttributeType::FLOAT:
-        vertexAtrrib.v1 = *((float*)(bytePtr));
-        break;
-    default:
-        // its UINT
-        vertexAtrrib.u1 = *((uint32_t*)(bytePtr));
-        break;
-    }
+uint32_t decodeNonIndexed(uint8_t const*, uint32_t shaderInvocation)
+{
+    return shaderInvocation;
 }
 
-uint32_t computeVertexID(GPUMemory& mem, VertexArray& vao, uint32_t shaderInvocation)
+template<typename INDEX>
+uint32_t decodeIndex(uint8_t const* indices, uint32_t shaderInvocation)
 {
-    if (vao.indexBufferID < 0) return shaderInvocation;
-
-    uint8_t* ind = (uint8_t*)mem.buffers[vao.indexBufferID].data + vao.indexOffset;
-    switch (vao.indexType)
-    {
-    case IndexType::UINT8:
-        return ((uint8_t*)ind)[shaderInvocation];
-    case IndexType::UINT16:
-        return ((uint16_t*)ind)[shaderInvocation];
-    default:
-        return ((uint32_t*)ind)[shaderInvocation];
-    }
+    INDEX index;
+    std::memcpy(&index, indices + shaderInvocation * sizeof(INDEX), sizeof(INDEX));
+    return index;
 }
 
-void runVertexAssembly(InVertex& inVertex, GPUMemory& mem, VertexArray& vao, uint32_t shaderInvocation)
+// reads N 32-bit components, the rest of the attribute keeps its value
+template<uint32_t N>
+void readComponents(Attribute& attribute, uint8_t const* bytePtr)
 {
-    inVertex.gl_VertexID = computeVertexID(mem, vao, shaderInvocation);
-
-    for (size_t i = 0; i < maxAttributes; ++i)
-    {
-        readAttributes(inVertex.attributes[i], mem, vao.vertexAttrib[i], inVertex.gl_VertexID);
-    }
+    std::memcpy(&attribute.u4[0], bytePtr, N * sizeof(uint32_t));
 }
 
-Triangle primitiveAssembly(GPUMemory& mem, DrawCommand& cmd, uint32_t drawID, uint32_t triangleIndex, ShaderInterface& si, Program& prg)
+/**
+ * Vertex array of one draw compiled into resolved pointers and specialized readers.
+ * Only enabled attributes are stored, draws without attributes fetch nothing.
+ */
+struct VertexFetchPlan {
+    struct AttributeFetch {
+        uint8_t const*  data;           // attribute of vertex 0
+        uint64_t        stride;
+        uint32_t        attribute;      // index into InVertex::attributes
+        uint32_t        nofComponents;
+        AttributeReader read;
+    };
+
+    IndexDecoder   decodeIndex = decodeNonIndexed;
+    uint8_t const* indices = nullptr;
+    uint32_t       nofAttributes = 0;
+    AttributeFetch attributes[maxAttributes];
+};
+
+VertexFetchPlan createVertexFetchPlan(GPUMemory& mem, VertexArray const& vao)
 {
-    Triangle triangle;
+    static AttributeReader const readers[] = { nullptr, readComponents<1>, readComponents<2>, readComponents<3>, readComponents<4> };
 
-    uint32_t firstVertexIndex = triangleIndex * 3;
-    for (uint32_t i = firstVertexIndex; i < firstVertexIndex + 3; ++i)
+    VertexFetchPlan plan;
+    if (vao.indexBufferID >= 0)
     {
-        InVertex inVertex;
-        OutVertex outVertex;
-        inVertex.gl_DrawID = drawID;
-
-        runVertexAssembly(inVertex, mem, cmd.vao, i);
+        plan.indices = (uint8_t const*)mem.buffers[vao.indexBufferID].data + vao.indexOffset;
+        switch (vao.indexType)
+        {
+        case IndexType::UINT8:
+            plan.decodeIndex = decodeIndex<uint8_t>;
+            break;
+        case IndexType::UINT16:
+            plan.decodeIndex = decodeIndex<uint16_t>;
+            break;
+        default:
+            plan.decodeIndex = decodeIndex<uint32_t>;
+            break;
+        }
+    }
 
-        prg.vertexShader(outVertex, inVertex, si);
-        triangle.points[i % 3] = outVertex;
+    for (uint32_t a = 0; a < maxAttributes; ++a)
+    {
+        VertexAttrib const& attrib = vao.vertexAttrib[a];
+        if (attrib.type == AttributeType::EMPTY) continue;
+
+        // the low bits of AttributeType are the number of components (float and uint alike)
+        auto& fetch = plan.attributes[plan.nofAttributes++];
+        fetch.data = (uint8_t const*)mem.buffers[attrib.bufferID].data + attrib.offset;
+        fetch.stride = attrib.stride;
+        fetch.attribute = a;
+        fetch.nofComponents = (uint32_t)attrib.type & 7u;
+        fetch.read = readers[fetch.nofComponents];
     }
 
-    return triangle;
+    return plan;
 }
 
-void perspectiveDivision(Triangle& triangle)
+inline uint32_t computeVertexID(VertexFetchPlan const& plan, uint32_t shaderInvocation)
 {
-    for (size_t i = 0; i < 3; ++i)
-    {
-        float w = triangle.points[i].gl_Position.w;
-        triangle.points[i].gl_Position.x /= w;
-        triangle.points[i].gl_Position.y /= w;
-        triangle.points[i].gl_Position.z /= w;
-    }
+    return plan.decodeIndex(plan.indices, shaderInvocation);
 }
 
-void viewportTransformation(Triangle& triangle, uint32_t halfWidth, uint32_t halfHeight)
+void runVertexAssembly(InVertex& inVertex, VertexFetchPlan const& plan, uint32_t shaderInvocation)
 {
-    for (size_t i = 0; i < 3; ++i)
+    inVertex.gl_VertexID = computeVertexID(plan, shaderInvocation);
+
+    for (uint32_t i = 0; i < plan.nofAttributes; ++i)
     {
-        triangle.points[i].gl_Position.x = (triangle.points[i].gl_Position.x + 1.0f) * halfWidth;
-        triangle.points[i].gl_Position.y = (triangle.points[i].gl_Position.y + 1.0f) * halfHeight;
+        auto const& fetch = plan.attributes[i];
+        fetch.read(inVertex.attributes[fetch.attribute], fetch.data + fetch.stride * inVertex.gl_VertexID);
     }
 }
 
-void loadAttributesToFragment(InFragment& inFragment, OutVertex& p1, OutVertex& p2, OutVertex& p3, AttributeType type, size_t i, double l0, float l1, float l2)
+void runVertexShader(OutVertex& outVertex, VertexFetchPlan const& plan, uint32_t drawID, uint32_t shaderInvocation, ShaderInterface const& si, Program const& prg)
 {
-    // dont interpolate integer attribs
-    switch (type)
-    {
-    case AttributeType::UINT:
-        inFragment.attributes[i].u1 = p1.attributes[i].u1;
-        return;
-    case AttributeType::UVEC2:
-        inFragment.attributes[i].u2 = p1.attributes[i].u2;
-        return;
-    case AttributeType::UVEC3:
-        inFragment.attributes[i].u3 = p1.attributes[i].u3;
-        return;
-    case AttributeType::UVEC4:
-        inFragment.attributes[i].u4 = p1.attributes[i].u4;
-        return;
-    default:
-        break;
-    }
+    InVertex inVertex;
+    inVertex.gl_DrawID = drawID;
 
-    // interpolate
-    float s = (float)(l0 / p1.gl_Position.w) + (l1 / p2.gl_Position.w) + (l2 / p3.gl_Position.w);
-    l0 /= p1.gl_Position.w * s;
-    l1 /= p2.gl_Position.w * s;
-    l2 /= p3.gl_Position.w * s;
+    runVertexAssembly(inVertex, plan, shaderInvocation);
 
-    switch (type)
-    {
-    case AttributeType::VEC4:
-        for (int vecI = 0; vecI < 4; vecI++) {
-            inFragment.attributes[i].v4[vecI] = (float)((p1.attributes[i].v4[vecI] * l0) + (p2.attributes[i].v4[vecI] * l1) + (p3.attributes[i].v4[vecI] * l2));
-        }
-        break;
+    outVertex = OutVertex();
+    prg.vertexShader(outVertex, inVertex, si);
+}
 
-    case AttributeType::VEC3:
-        for (int vecI = 0; vecI < 3; vecI++) {
-            inFragment.attributes[i].v3[vecI] = (float)((p1.attributes[i].v3[vecI] * l0) + (p2.attributes[i].v3[vecI] * l1) + (p3.attributes[i].v3[vecI] * l2));
-        }
-        break;
-    case AttributeType::VEC2:
-        for (int vecI = 0; vecI < 2; vecI++) {
-            inFragment.attributes[i].v2[vecI] = (float)((p1.attributes[i].v2[vecI] * l0) + (p2.attributes[i].v2[vecI] * l1) + (p3.attributes[i].v2[vecI] * l2));
-        }
-        break;
-    default:
-        // its FLOAT
-        inFragment.attributes[i].v1 = (float)((p1.attributes[i].v1 * l0) + (p2.attributes[i].v1 * l1) + (p3.attributes[i].v1 * l2));
-        break;
+/**
+ * Gathers one attribute of packet vertices into SoA lanes.
+ */
+void gatherAttribute(AttributeLanes& lanes, VertexFetchPlan::AttributeFetch const& fetch, uint32_t const* vertexIDs, uint32_t nofVertices)
+{
+    for (uint32_t i = 0; i < nofVertices; ++i)
+    {
+        uint8_t const* bytePtr = fetch.data + fetch.stride * vertexIDs[i];
+        for (uint32_t c = 0; c < fetch.nofComponents; ++c)
+            std::memcpy(&lanes.u[c][i], bytePtr + c * sizeof(uint32_t), sizeof(uint32_t));
     }
 }
 
-void perFragmentOperations(Frame& framebuffer, OutFragment& outFragment, float depth, float x, float y)
+/**
+ * Runs batched vertex shader for invocations first .. first + nofVertices (at most one packet),
+ * results are scattered back to outVertices[first + i].
+ */
+template<typename INVOCATION>
+void runVertexPacketShader(OutVertex* outVertices, VertexFetchPlan const& plan, uint32_t drawID, INVOCATION const& invocation, uint32_t first, uint32_t nofVertices, ShaderInterface const& si, Program const& prg)
 {
-    x -= 0.5f;
-    y -= 0.5f;
-
-    int pixelPos = (int)(x + y * framebuffer.width);
-
-    if (depth >= framebuffer.depth[pixelPos])
+    InVertexPacket inPacket;
+    inPacket.gl_DrawID = drawID;
+    inPacket.nofVertices = nofVertices;
+    for (uint32_t i = 0; i < nofVertices; ++i)
+        inPacket.gl_VertexID[i] = computeVertexID(plan, invocation(first + i));
+
+    // same defaults as InVertex and OutVertex
+    OutVertexPacket outPacket;
+    for (uint32_t i = 0; i < vertexPacketSize; ++i)
     {
-        // discard fragment
-        return;
+        for (uint32_t a = 0; a < maxAttributes; ++a)
+            for (uint32_t c = 0; c < 4; ++c)
+                inPacket.attributes[a].v[c][i] = outPacket.attributes[a].v[c][i] = 1.f;
+        for (uint32_t c = 0; c < 4; ++c)
+            outPacket.gl_Position[c][i] = c == 3 ? 1.f : 0.f;
     }
 
-    glm::vec4 color = outFragment.gl_FragColor;
-    color.r = glm::clamp(color.r, 0.f, 1.f);    // r
-    color.g = glm::clamp(color.g, 0.f, 1.f);    // g
-    color.b = glm::clamp(color.b, 0.f, 1.f);    // b
-    color.a = glm::clamp(color.a, 0.f, 1.f);    // alpha
+    for (uint32_t i = 0; i < plan.nofAttributes; ++i)
+        gatherAttribute(inPacket.attributes[plan.attributes[i].attribute], plan.attributes[i], inPacket.gl_VertexID, nofVertices);
 
-    int pos = pixelPos * framebuffer.channels;
+    prg.vertexPacketShader(outPacket, inPacket, si);
 
-    // update depth only if alpha is > 0.5f
-    if (color.a > 0.5f)
+    for (uint32_t i = 0; i < nofVertices; ++i)
     {
-        framebuffer.depth[pixelPos] = depth;
+        OutVertex& outVertex = outVertices[first + i];
+        for (uint32_t a = 0; a < maxAttributes; ++a)
+            for (uint32_t c = 0; c < 4; ++c)
+                outVertex.attributes[a].u4[c] = outPacket.attributes[a].u[c][i];
+        for (uint32_t c = 0; c < 4; ++c)
+            outVertex.gl_Position[c] = outPacket.gl_Position[c][i];
     }
-
-    framebuffer.color[pos + 0] = (uint8_t)((framebuffer.color[pos + 0] * (1.f - color.a)) + ((color.r * 255.f) * color.a));
-    framebuffer.color[pos + 1] = (uint8_t)((framebuffer.color[pos + 1] * (1.f - color.a)) + ((color.g * 255.f) * color.a));
-    framebuffer.color[pos + 2] = (uint8_t)((framebuffer.color[pos + 2] * (1.f - color.a)) + ((color.b * 255.f) * color.a));
-    framebuffer.color[pos + 3] = (uint8_t)color.a;
 }
 
-void loadFragmentToShader(Frame& frame, float x, float y, Program& prg, ShaderInterface& si, OutVertex& p1, OutVertex& p2, OutVertex& p3, float area, float area2, float area3)
+Triangle primitiveAssembly(OutVertex const* outVertices, uint32_t const* vertexSlots, uint32_t triangleIndex)
 {
-    float l0 = area2 / area;
-    float l1 = area3 / area;
-    float l2 = 1.f - l0 - l1;
-    float depth = p1.gl_Position.z * l0 + p2.gl_Position.z * l1 + p3.gl_Position.z * l2;
-
-    InFragment inFragment;
-    inFragment.gl_FragCoord.x = x;
-    inFragment.gl_FragCoord.y = y;
-    inFragment.gl_FragCoord.z = depth;
-
-    for (size_t i = 0; i < maxAttributes; i++)
-    {
-        if (prg.vs2fs[i] != AttributeType::EMPTY)
-            loadAttributesToFragment(inFragment, p1, p2, p3, prg.vs2fs[i], i, l0, l1, l2);
-    }
-
-    OutFragment outFragment;
-    prg.fragmentShader(outFragment, inFragment, si);
+    Triangle triangle;
 
-    perFragmentOperations(frame, outFragment, depth, x, y);
+    uint32_t firstVertexIndex = triangleIndex * 3;
+    for (uint32_t i = 0; i < 3; ++i)
+        triangle.points[i] = outVertices[vertexSlots[firstVertexIndex + i]];
 
+    return triangle;
 }
 
-float edgeFunction(OutVertex& a, OutVertex& b, OutVertex& c)
+void perspectiveDivision(OutVertex& vertex)
 {
-    return (c.gl_Position.x - a.gl_Position.x) * (b.gl_Position.y - a.gl_Position.y) - (c.gl_Position.y - a.gl_Position.y) * (b.gl_Position.x - a.gl_Position.x);
+    float w = vertex.gl_Position.w;
+    vertex.gl_Position.x /= w;
+    vertex.gl_Position.y /= w;
+    vertex.gl_Position.z /= w;
 }
 
-bool isFacingCamera(glm::vec3& cameraPos, glm::vec3& vertexNorm)
+void viewportTransformation(OutVertex& vertex, uint32_t halfWidth, uint32_t halfHeight)
 {
-    return glm::dot(vertexNorm, cameraPos) > 0;
+    vertex.gl_Position.x = (vertex.gl_Position.x + 1.0f) * halfWidth;
+    vertex.gl_Position.y = (vertex.gl_Position.y + 1.0f) * halfHeight;
 }
 
-void rasterize(Triangle& triangle, DrawCommand& cmd, ShaderInterface& si, Frame& frame, Program& prg, glm::vec3& cameraVec)
-{
-    // check if all points of the triangle are same
-    if (triangle.points[0].gl_Position == triangle.points[1].gl_Position && triangle.points[1].gl_Position == triangle.points[2].gl_Position)
-        return;
-
-    // check if triangle is facing a camera, if not discard it.
-    if (cmd.backfaceCulling && !isFacingCamera(cameraVec, triangle.points[0].attributes[1].v3))
-        return;
+uint32_t const rasterBlockSize = 8; ///< width and height of block that is accepted/rejected as a whole
+uint32_t const tileSize = 64;       ///< width and height of one screen tile
 
-    // calculate area of whole triangle
-    float triangleArea = edgeFunction(triangle.points[0], triangle.points[1], triangle.points[2]);
+/**
+ * Farthest depth stored in 8x8 blocks and in tiles of the frame (hierarchical Z).
+ * Depth test passes only for nearer fragments, so the depth of a pixel decreases until the next clear
+ * and stored values stay conservative even when they are not tightened after every write.
+ */
+struct HierarchicalDepth {
+    uint32_t           blocksX = 0;
+    uint32_t           blocksY = 0;
+    uint32_t           tilesX = 0;
+    uint32_t           tilesY = 0;
+    std::vector<float> blocks;
+    std::vector<float> tiles;
+};
 
-    // check if triangle is cw or ccw
-    bool clockwise = true;
-    if (triangleArea < 0)
-    {
-        clockwise = false;
-        triangleArea = abs(triangleArea);
-    }
+void updateHierarchicalTile(HierarchicalDepth& hiZ, uint32_t tx, uint32_t ty)
+{
+    uint32_t const blocksPerTile = tileSize / rasterBlockSize;
 
-    if (clockwise && cmd.backfaceCulling)
-        return;
+    float farthest = -std::numeric_limits<float>::infinity();
+    for (uint32_t by = ty * blocksPerTile; by < glm::min((ty + 1) * blocksPerTile, hiZ.blocksY); ++by)
+        for (uint32_t bx = tx * blocksPerTile; bx < glm::min((tx + 1) * blocksPerTile, hiZ.blocksX); ++bx)
+            farthest = glm::max(farthest, hiZ.blocks[bx + by * hiZ.blocksX]);
+    hiZ.tiles[tx + ty * hiZ.tilesX] = farthest;
+}
 
-    ////////////////////////////////////////////////////////////////
-    // bounding box
-    float min_x = glm::min(triangle.points[0].gl_Position.x, glm::min(triangle.points[1].gl_Position.x, triangle.points[2].gl_Position.x));
-    float min_y = glm::min(triangle.points[0].gl_Position.y, glm::min(triangle.points[1].gl_Position.y, triangle.points[2].gl_Position.y));
+void clearHierarchicalDepth(HierarchicalDepth& hiZ, float depth)
+{
+    if (depth != depth)
+        depth = std::numeric_limits<float>::infinity();
+    std::fill(hiZ.blocks.begin(), hiZ.blocks.end(), depth);
+    std::fill(hiZ.tiles.begin(), hiZ.tiles.end(), depth);
+}
 
-    float max_x = glm::max(triangle.points[0].gl_Position.x, glm::max(triangle.points[1].gl_Position.x, triangle.points[2].gl_Position.x));
-    float max_y = glm::max(triangle.points[0].gl_Position.y, glm::max(triangle.points[1].gl_Position.y, triangle.points[2].gl_Position.y));
+uint8_t const pendingColor = 1; ///< block still has to be filled by the clear color
+uint8_t const pendingDepth = 2; ///< block still has to be filled by the clear depth
 
-    min_x = (int)glm::max(min_x, 0.f) + 0.5f;
-    min_y = (int)glm::max(min_y, 0.f) + 0.5f;
-    max_x = (float)((int)(glm::min(max_x + 1.f, ((float)frame.width))));
-    max_y = (float)((int)(glm::min(max_y + 1.f, ((float)frame.height))));
-    ////////////////////////////////////////////////////////////////
+/**
+ * Clears that are not written into 8x8 blocks of the frame yet (fast clear).
+ * Clear only marks all blocks, a block is filled when the rasterizer touches it for the first time
+ * and untouched blocks are filled at the end of execution, so a clear writes every pixel once.
+ */
+struct PendingClears {
+    uint32_t             blocksX = 0;
+    uint32_t             color = 0;    // packed clear color
+    float                depth = 0.f;
+    std::vector<uint8_t> blocks;       // pendingColor and pendingDepth bits of every block
+};
 
+/**
+ * Part of the framebuffer written by the rasterizer.
+ * Storage is either the whole frame or a small tile buffer, pixels are addressed relative to (minX, minY).
+ * Storage is split into rasterBlockSize x rasterBlockSize blocks aligned to (minX, minY), see pixelIndex.
+ * Rows of the frame are blocks laid side by side, the blocked layout stores every block in one piece,
+ * so a block touched by the rasterizer occupies few cache lines. Row of a block is always contiguous.
+ */
+struct RenderTarget {
+    uint8_t* color;
+    float*   depth;
+    uint32_t channels;
+    uint32_t rowStride;      // number of pixels between rows of a block
+    uint32_t blockStride;    // number of pixels between horizontally neighbouring blocks
+    uint32_t blockRowStride; // number of pixels between rows of blocks
+    int32_t  minX, minY;     // first pixel covered by storage
+    int32_t  maxX, maxY;     // one past the last pixel covered by storage
+    HierarchicalDepth* hiZ;  // coarse depth of the whole frame, target covers whole blocks and tiles of it
+    PendingClears*     clears; // clears of the whole frame not written into storage yet, nullptr without fast clear
+};
 
-    ////////////////////////////////////////////////////////////////
-    // point[1] - point[0]
-    glm::vec2 dirVec1 = glm::vec2(triangle.points[1].gl_Position.x - triangle.points[0].gl_Position.x, triangle.points[1].gl_Position.y - triangle.points[0].gl_Position.y);
-    // point[2] - point[1]
-    glm::vec2 dirVec2 = glm::vec2(triangle.points[2].gl_Position.x - triangle.points[1].gl_Position.x, triangle.points[2].gl_Position.y - triangle.points[1].gl_Position.y);
-    // point[0] - point[2]
-    glm::vec2 dirVec3 = glm::vec2(triangle.points[0].gl_Position.x - triangle.points[2].gl_Position.x, triangle.points[0].gl_Position.y - triangle.points[2].gl_Position.y);
+/**
+ * Render target storing pixels in rows of stride pixels.
+ */
+RenderTarget linearRenderTarget(uint8_t* color, float* depth, uint32_t channels, uint32_t stride, glm::ivec4 const& area)
+{
+    return { color, depth, channels, stride, rasterBlockSize, stride * rasterBlockSize, area.x, area.y, area.z, area.w, nullptr, nullptr };
+}
 
-    // EDGE FUNCTIONS
-    float E1 = ((min_y - triangle.points[0].gl_Position.y) * dirVec1.x) - ((min_x - triangle.points[0].gl_Position.x) * dirVec1.y);
-    float E2 = ((min_y - triangle.points[1].gl_Position.y) * dirVec2.x) - ((min_x - triangle.points[1].gl_Position.x) * dirVec2.y);
-    float E3 = ((min_y - triangle.points[2].gl_Position.y) * dirVec3.x) - ((min_x - triangle.points[2].gl_Position.x) * dirVec3.y);
-    ////////////////////////////////////////////////////////////////
+RenderTarget frameRenderTarget(Frame& frame)
+{
+    return linearRenderTarget(frame.color, frame.depth, frame.channels, frame.width, glm::ivec4(0, 0, frame.width, frame.height));
+}
 
-    if (!clockwise)
-    {
-        for (float y = min_y; y < max_y; y++)
-        {
-            float t1 = E1;
-            float t2 = E2;
-            float t3 = E3;
-            bool insideTriangle = false;
+uint32_t const blockPixels = rasterBlockSize * rasterBlockSize;
 
-            for (float x = min_x; x < max_x; x++)
-            {
-                if (t1 >= 0 && t2 > 0 && t3 >= 0)
-                {
-                    loadFragmentToShader(frame, x, y, prg, si, triangle.points[0], triangle.points[1], triangle.points[2], triangleArea, t2, t3);
-                    insideTriangle = true;
-                }
-                else if (insideTriangle)
-                {
-                    // got out of triangle
-                    break;
-                }
+/**
+ * Frame stored in blocks, rows of blocks are padded to whole blocks.
+ */
+RenderTarget blockedRenderTarget(uint8_t* color, float* depth, uint32_t channels, uint32_t width, uint32_t height)
+{
+    uint32_t blocksX = (width + rasterBlockSize - 1) / rasterBlockSize;
+    return { color, depth, channels, rasterBlockSize, blockPixels, blocksX * blockPixels, 0, 0, (int32_t)width, (int32_t)height, nullptr, nullptr };
+}
 
-                t1 -= dirVec1.y;
-                t2 -= dirVec2.y;
-                t3 -= dirVec3.y;
-            }
+size_t pixelIndex(RenderTarget const& target, int x, int y)
+{
+    uint32_t localX = x - target.minX;
+    uint32_t localY = y - target.minY;
+    return (size_t)(localY / rasterBlockSize) * target.blockRowStride + (localX / rasterBlockSize) * target.blockStride
+        + (localY % rasterBlockSize) * target.rowStride + localX % rasterBlockSize;
+}
 
-            E1 += dirVec1.x;
-            E2 += dirVec2.x;
-            E3 += dirVec3.x;
-        }
-    }
-    else
-    {
-        for (float y = min_y; y < max_y; y++)
+/**
+ * Copies pixels [x0, x1) x [y0, y1) between render targets of any layout, x0 is aligned to blocks.
+ * Contiguous rows of blocks are moved by SSE.
+ */
+void copyPixels(RenderTarget const& dst, RenderTarget const& src, int x0, int y0, int x1, int y1)
+{
+    uint32_t channels = src.channels;
+    for (int y = y0; y < y1; ++y)
+        for (int x = x0; x < x1; x += rasterBlockSize)
         {
-            float t1 = E1;
-            float t2 = E2;
-            float t3 = E3;
-            bool insideTriangle = false;
+            uint8_t* dstColor = dst.color + pixelIndex(dst, x, y) * channels;
+            uint8_t const* srcColor = src.color + pixelIndex(src, x, y) * channels;
+            float* dstDepth = dst.depth + pixelIndex(dst, x, y);
+            float const* srcDepth = src.depth + pixelIndex(src, x, y);
 
-            for (float x = min_x; x < max_x; x++)
+            uint32_t n = glm::min(x1 - x, (int)rasterBlockSize);
+            if (n == rasterBlockSize && channels == 4)
             {
-                if (t1 <= 0 && t2 <= 0 && t3 <= 0)
-                {
-                    loadFragmentToShader(frame, x, y, prg, si, triangle.points[0], triangle.points[1], triangle.points[2], triangleArea, abs(t2), abs(t3));
-                    insideTriangle = true;
-                }
-                else if (insideTriangle)
-                {
-                    // didnt rasterize a current pixel, but did previous
-                    break;
-                }
-
-                t1 -= dirVec1.y;
-                t2 -= dirVec2.y;
-                t3 -= dirVec3.y;
+                static_assert(rasterBlockSize == 8, "row of a block is moved by two 16 byte registers");
+                _mm_storeu_si128((__m128i*)dstColor, _mm_loadu_si128((__m128i const*)srcColor));
+                _mm_storeu_si128((__m128i*)dstColor + 1, _mm_loadu_si128((__m128i const*)srcColor + 1));
+                _mm_storeu_ps(dstDepth, _mm_loadu_ps(srcDepth));
+                _mm_storeu_ps(dstDepth + 4, _mm_loadu_ps(srcDepth + 4));
+                continue;
             }
-
-            E1 += dirVec1.x;
-            E2 += dirVec2.x;
-            E3 += dirVec3.x;
+            memcpy(dstColor, srcColor, n * channels);
+            memcpy(dstDepth, srcDepth, n * sizeof(float));
         }
-    }
 }
 
-void cutEdge(OutVertex& a, OutVertex& b, Program& prg)
+void initPendingClears(PendingClears& clears, RenderTarget const& frame)
 {
-    float t = (-a.gl_Position.w - a.gl_Position.z) / (b.gl_Position.w - a.gl_Position.w + b.gl_Position.z - a.gl_Position.z);
-
-    a.gl_Position += t * (b.gl_Position - a.gl_Position);
-
-    for (uint32_t i = 0; i < maxAttributes; i++)
-    {
-        switch (prg.vs2fs[i])
-        {
-        case AttributeType::FLOAT:
-            a.attributes[i].v1 += t * (b.attributes[i].v1 - a.attributes[i].v1);
-            continue;
-        case AttributeType::VEC2:
-            a.attributes[i].v2 += t * (b.attributes[i].v2 - a.attributes[i].v2);
-            continue;
-        case AttributeType::VEC3:
-            a.attributes[i].v3 += t * (b.attributes[i].v3 - a.attributes[i].v3);
-            continue;
-        case AttributeType::VEC4:
-            a.attributes[i].v4 += t * (b.attributes[i].v4 - a.attributes[i].v4);
-            continue;
-        case AttributeType::UINT:
-            a.attributes[i].u1 += (uint32_t)t * (b.attributes[i].u1 - a.attributes[i].u1);
-            continue;
-        case AttributeType::UVEC2:
-            a.attributes[i].u2 += (uint32_t)t * (b.attributes[i].u2 - a.attributes[i].u2);
-            continue;
-        case AttributeType::UVEC3:
-            a.attributes[i].u3 += (uint32_t)t * (b.attributes[i].u3 - a.attributes[i].u3);
-            continue;
-        case AttributeType::UVEC4:
-            a.attributes[i].u4 += (uint32_t)t * (b.attributes[i].u4 - a.attributes[i].u4);
-            continue;
-        default:
-            break;
-        }
-    }
+    clears.blocksX = (frame.maxX + rasterBlockSize - 1) / rasterBlockSize;
+    uint32_t blocksY = (frame.maxY + rasterBlockSize - 1) / rasterBlockSize;
+    clears.blocks.assign(clears.blocksX * blocksY, 0);
 }
 
-int clipping(Triangle& triangle, Triangle& secondTriangle, Program& prg)
+uint8_t& pendingBlock(PendingClears& clears, int x, int y)
 {
-    bool isInsideCameraMask[3];
-    isInsideCameraMask[0] = (-triangle.points[0].gl_Position.w) > triangle.points[0].gl_Position.z;
-    isInsideCameraMask[1] = (-triangle.points[1].gl_Position.w) > triangle.points[1].gl_Position.z;
-    isInsideCameraMask[2] = (-triangle.points[2].gl_Position.w) > triangle.points[2].gl_Position.z;
+    return clears.blocks[x / rasterBlockSize + y / rasterBlockSize * clears.blocksX];
+}
 
-    if (isInsideCameraMask[0] && isInsideCameraMask[1] && isInsideCameraMask[2])
-    {
-        // whole triangle is inside of camera, discard it.
-        return 0;
-    }
-    else if (!isInsideCameraMask[0] && !isInsideCameraMask[1] && !isInsideCameraMask[2])
+/**
+ * Writes pending clears of the block starting at pixel (x, y), target has to cover the block.
+ */
+void fillPendingBlock(RenderTarget const& target, PendingClears& clears, int x, int y)
+{
+    uint8_t& pending = pendingBlock(clears, x, y);
+    int width = glm::min(x + (int)rasterBlockSize, target.maxX) - x;
+    int height = glm::min(y + (int)rasterBlockSize, target.maxY) - y;
+    for (int row = y; row < y + height; ++row)
     {
-        // whole triangle is outside of camera, no clipping needed.
-        return 1;
+        size_t pixel = pixelIndex(target, x, row);
+        if (pending & pendingColor)
+            std::fill_n(reinterpret_cast<uint32_t*>(target.color) + pixel, width, clears.color);
+        if (pending & pendingDepth)
+            std::fill_n(target.depth + pixel, width, clears.depth);
     }
+    pending = 0;
+}
 
-    // CLIPPING NEEDED
-    if (!isInsideCameraMask[0] && isInsideCameraMask[1] && isInsideCameraMask[2])
-    {
-        // Point 0 OK (is not inside)
-        cutEdge(triangle.points[1], triangle.points[0], prg);  // change point 1
-        cutEdge(triangle.points[2], triangle.points[0], prg);  // change point 2
-        return 1;
-    }
-    else if (isInsideCameraMask[0] && !isInsideCameraMask[1] && isInsideCameraMask[2])
-    {
-        // Point 1 OK (is not inside)
-        cutEdge(triangle.points[0], triangle.points[1], prg);  // change point 0
-        cutEdge(triangle.points[2], triangle.points[1], prg);  // change point 2
-        return 1;
-    }
-    else if (isInsideCameraMask[0] && isInsideCameraMask[1] && !isInsideCameraMask[2])
+/**
+ * Stores one row of a block by non-temporal stores if it is aligned.
+ */
+void streamBlockRow(void* destination, __m128i value)
+{
+    __m128i* row = (__m128i*)destination;
+    if (((uintptr_t)row & 15) == 0)
     {
-        // Point 2 OK (is not inside)
-        cutEdge(triangle.points[0], triangle.points[2], prg);  // change point 0
-        cutEdge(triangle.points[1], triangle.points[2], prg);  // change point 1
-        return 1;
+        _mm_stream_si128(row, value);
+        _mm_stream_si128(row + 1, value);
+        return;
     }
-    else if (isInsideCameraMask[0])
-    {
-        // Points 1, 2 OK (not inside)
-        memcpy(&secondTriangle, &triangle, sizeof(Triangle));                 // make a copy of a triangle
+    _mm_storeu_si128(row, value);
+    _mm_storeu_si128(row + 1, value);
+}
 
-        cutEdge(triangle.points[0], triangle.points[1], prg);             // change point 0
-        cutEdge(secondTriangle.points[0], secondTriangle.points[2], prg); // change point 0 of second triangle
-        triangle.points[2] = secondTriangle.points[0];                    // change point of first triangle to second intersection
-        return 2;
-    }
-    else if (isInsideCameraMask[1])
-    {
-        // Points 0, 2 OK (not inside)
-        memcpy(&secondTriangle, &triangle, sizeof(Triangle));                 // make a copy of a triangle
+/**
+ * Fills n values by non-temporal stores, the buffer is larger than caches and the stores do not read it first.
+ */
+void streamFill(uint32_t* destination, size_t n, uint32_t value)
+{
+    size_t i = 0;
+    for (; i < n && ((uintptr_t)(destination + i) & 15); ++i)
+        destination[i] = value;
 
-        cutEdge(triangle.points[1], triangle.points[0], prg);              // change point 1
-        cutEdge(secondTriangle.points[1], secondTriangle.points[2], prg);  // change point 1 of second triangle
-        triangle.points[2] = secondTriangle.points[1];                           // change point of first triangle to second intersection
-        return 2;
-    }
-    else
-    {
-        // Points 0, 1 OK (not inside)
-        memcpy(&secondTriangle, &triangle, sizeof(Triangle));                 // make a copy of a triangle
+    __m128i values = _mm_set1_epi32((int)value);
+    for (; i + 4 <= n; i += 4)
+        _mm_stream_si128((__m128i*)(destination + i), values);
+    _mm_sfence();
 
-        cutEdge(triangle.points[2], triangle.points[0], prg);             // change point 2
-        cutEdge(secondTriangle.points[2], secondTriangle.points[1], prg); // change point 2 of second triangle
-        triangle.points[1] = secondTriangle.points[2];                    // change point of first triangle to second intersection
-        return 2;
-    }
+    for (; i < n; ++i)
+        destination[i] = value;
 }
 
-void draw(GPUMemory& mem, DrawCommand& cmd, uint32_t drawID)
+/**
+ * Writes pending clears of all blocks that were not touched during execution.
+ * Filled pixels are not read by the gpu again, so they are written around the cache.
+ */
+void resolvePendingClears(RenderTarget const& frame)
 {
-    ShaderInterface si;
-    si.uniforms = mem.uniforms;
-    si.textures = mem.textures;
-
-    Frame     frame = mem.framebuffer;
-    Program   prg = mem.programs[cmd.programID];
-    glm::vec3 cameraVec = mem.uniforms[2].v3;
-
-    uint32_t halfWidth = mem.framebuffer.width >> 1;
-    uint32_t halfHeight = mem.framebuffer.height >> 1;
+    if (!frame.clears)
+        return;
 
-    for (uint32_t triangleIndex = 0; triangleIndex < cmd.nofVertices / 3; triangleIndex++)
+    PendingClears& clears = *frame.clears;
+    __m128i color = _mm_set1_epi32((int)clears.color);
+    __m128i depth = _mm_castps_si128(_mm_set1_ps(clears.depth));
+
+    auto fillRow = [&](int x, int y) {
+        uint8_t pending = pendingBlock(clears, x, y);
+        if (!pending)
+            return;
+        size_t pixel = pixelIndex(frame, x, y);
+        int width = glm::min(x + (int)rasterBlockSize, frame.maxX) - x;
+        if (width < (int)rasterBlockSize)
+        {
+            if (pending & pendingColor)
+                std::fill_n(reinterpret_cast<uint32_t*>(frame.color) + pixel, width, clears.color);
+            if (pending & pendingDepth)
+                std::fill_n(frame.depth + pixel, width, clears.depth);
+            return;
+        }
+        if (pending & pendingColor)
+            streamBlockRow(reinterpret_cast<uint32_t*>(frame.color) + pixel, color);
+        if (pending & pendingDepth)
+            streamBlockRow(frame.depth + pixel, depth);
+    };
+
+    // stores go to consecutive addresses, so write combining sends whole cache lines to memory
+    bool blocked = frame.rowStride < frame.blockStride;
+    for (int y = 0; y < frame.maxY; y += rasterBlockSize)
     {
-        Triangle triangle = primitiveAssembly(mem, cmd, drawID, triangleIndex, si, prg);
-        Triangle secondTriangle;
-
-        switch (clipping(triangle, secondTriangle, prg))
+        int height = glm::min(y + (int)rasterBlockSize, frame.maxY) - y;
+        if (blocked)
         {
-        case 0:
-            // dont rasterize this triangle
-            continue;
-        case 1:
-            // one triangle to rasterize
-            break;
-        case 2:
-            // two triangles to rasterize
-            perspectiveDivision(secondTriangle);
-            viewportTransformation(secondTriangle, halfWidth, halfHeight);
-            rasterize(secondTriangle, cmd, si, frame, prg, cameraVec);
-            break;
+            for (int x = 0; x < frame.maxX; x += rasterBlockSize)
+                for (int row = y; row < y + height; ++row)
+                    fillRow(x, row);
+        }
+        else
+        {
+            for (int row = y; row < y + height; ++row)
+                for (int x = 0; x < frame.maxX; x += rasterBlockSize)
+                    fillRow(x, row);
         }
-
-        perspectiveDivision(triangle);
-        viewportTransformation(triangle, halfWidth, halfHeight);
-        rasterize(triangle, cmd, si, frame, prg, cameraVec);
     }
-}
-
-void clear(GPUMemory& mem, ClearCommand& cmd) {
-    if (cmd.clearColor) {
-        uint32_t combinedValue = 0;
-        combinedValue |= ((uint32_t)(cmd.color.r * 255.f));
-        combinedValue |= ((uint32_t)(cmd.color.g * 255.f)) << 8;
-        combinedValue |= ((uint32_t)(cmd.color.b * 255.f)) << 16;
-        combinedValue |= ((uint32_t)(cmd.color.a * 255.f)) << 24;
+    _mm_sfence();
 
-        uint32_t* arr = reinterpret_cast<uint32_t*>(mem.framebuffer.color);
+    std::fill(clears.blocks.begin(), clears.blocks.end(), 0);
+}
 
-        size_t colorBuffLenght = mem.framebuffer.width * mem.framebuffer.height;
-        std::fill_n(arr, colorBuffLenght, combinedValue);
-    }
-    if (cmd.clearDepth)
+/**
+ * Farthest depth of width x height pixels starting at (x, y) inside of one block, NaN is farther than anything.
+ */
+float farthestDepth(RenderTarget const& target, int x, int y, uint32_t width, uint32_t height)
+{
+    float farthest = -std::numeric_limits<float>::infinity();
+    for (uint32_t row = 0; row < height; ++row)
     {
-        std::fill_n(mem.framebuffer.depth, mem.framebuffer.width * mem.framebuffer.height, cmd.depth);
+        float const* depth = target.depth + pixelIndex(target, x, y + row);
+        for (uint32_t column = 0; column < width; ++column)
+        {
+            float value = depth[column];
+            if (!(value <= farthest))
+                farthest = value == value ? value : std::numeric_limits<float>::infinity();
+        }
     }
+    return farthest;
 }
 
-//! [gpu_execute]
-void gpu_execute(GPUMemory& mem, CommandBuffer& cb) {
-    (void)mem;
-    (void)cb;
-    /// \todo Tato funkce reprezentuje funkcionalitu grafické karty.<br>
-    /// Měla by umět zpracovat command buffer, čistit framebuffer a kresli.<br>
-    /// mem obsahuje paměť grafické karty.
-    /// cb obsahuje command buffer pro zpracování.
-    /// Bližší informace jsou uvedeny na hlavní stránce dokumentace.
-
-    uint32_t drawID = 0;
-
-    for (uint32_t i = 0; i < cb.nofCommands; ++i) {
-        CommandType type = cb.commands[i].type;
-        CommandData data = cb.commands[i].data;
-        if (type == CommandType::CLEAR)
-            clear(mem, data.clearCommand);
-        if (type == CommandType::DRAW)
+void buildHierarchicalDepth(HierarchicalDepth& hiZ, RenderTarget const& frame)
+{
+    uint32_t width = frame.maxX;
+    uint32_t height = frame.maxY;
+    hiZ.blocksX = (width + rasterBlockSize - 1) / rasterBlockSize;
+    hiZ.blocksY = (height + rasterBlockSize - 1) / rasterBlockSize;
+    hiZ.tilesX = (width + tileSize - 1) / tileSize;
+    hiZ.tilesY = (height + tileSize - 1) / tileSize;
+    hiZ.blocks.resize(hiZ.blocksX * hiZ.blocksY);
+    hiZ.tiles.resize(hiZ.tilesX * hiZ.tilesY);
+
+    for (uint32_t by = 0; by < hiZ.blocksY; ++by)
+        for (uint32_t bx = 0; bx < hiZ.blocksX; ++bx)
         {
-            draw(mem, data.drawCommand, drawID);
-            drawID++;
+            uint32_t x = bx * rasterBlockSize;
+            uint32_t y = by * rasterBlockSize;
+            hiZ.blocks[bx + by * hiZ.blocksX] = farthestDepth(frame, x, y,
+                glm::min(rasterBlockSize, width - x), glm::min(rasterBlockSize, height - y));
         }
-    }
+
+    for (uint32_t ty = 0; ty < hiZ.tilesY; ++ty)
+        for (uint32_t tx = 0; tx < hiZ.tilesX; ++tx)
+            updateHierarchicalTile(hiZ, tx, ty);
 }
-//! [gpu_execute]
+
+struct TriangleSetup;
 
 /**
- * @brief This function reads color from texture.
- *
- * @param texture texture
+ * Rasterizer of one block specialized for a program configuration, see selectBlockRasterizer.
+ */
+using BlockRasterizer = bool (*)(TriangleSetup const& setup, int x0, int y0, int x1, int y1, int testedEdges);
+
+BlockRasterizer selectBlockRasterizer(Program const& prg);
+
+/**
+ * Everything the rasterizer needs to know about the draw command a triangle belongs to.
+ */
+struct DrawState {
+    Program         prg;
+    ShaderInterface si;
+    bool            backfaceCulling;
+    float           frontFaceSign;  // sign of clip space determinant of front facing triangles
+    BlendMode       blendMode;
+    BlockRasterizer rasterizeBlock;
+};
+
+DrawState createDrawState(GPUMemory& mem, DrawCommand& cmd)
+{
+    DrawState state;
+    state.prg = mem.programs[cmd.programID];
+    state.si.uniforms = mem.uniforms;
+    state.si.textures = mem.textures;
+    state.backfaceCulling = cmd.backfaceCulling;
+    state.frontFaceSign = cmd.frontFace == FrontFace::CCW ? 1.f : -1.f;
+    state.blendMode = cmd.blendMode;
+    state.rasterizeBlock = selectBlockRasterizer(state.prg);
+    return state;
+}
+
+/**
+ * Rounded x * y / 255 of 8-bit values in fixed point.
+ */
+uint32_t multiplyUnorm8(uint32_t x, uint32_t y)
+{
+    uint32_t product = x * y + 128;
+    return (product + (product >> 8)) >> 8;
+}
+
+/**
+ * @return true if depth was written
+ */
+bool perFragmentOperations(RenderTarget& target, BlendMode blendMode, OutFragment& outFragment, float depth, int x, int y, bool depthTested)
+{
+    size_t pixelPos = pixelIndex(target, x, y);
+
+    if (!depthTested && depth >= target.depth[pixelPos])
+    {
+        // discard fragment
+        return false;
+    }
+
+    glm::vec4 color = outFragment.gl_FragColor;
+    color.r = glm::clamp(color.r, 0.f, 1.f);    // r
+    color.g = glm::clamp(color.g, 0.f, 1.f);    // g
+    color.b = glm::clamp(color.b, 0.f, 1.f);    // b
+    color.a = glm::clamp(color.a, 0.f, 1.f);    // alpha
+
+    size_t pos = pixelPos * target.channels;
+
+    // update depth only if alpha is > 0.5f
+    bool depthWritten = color.a > 0.5f;
+    if (depthWritten)
+    {
+        target.depth[pixelPos] = depth;
+    }
+
+    switch (blendMode)
+    {
+    case BlendMode::DISABLED:
+    {
+        // same as alpha blending of an opaque fragment, the pixel is written at once without reading it
+        uint32_t pixel = (uint32_t)(uint8_t)(color.r * 255.f) | (uint32_t)(uint8_t)(color.g * 255.f) << 8
+            | (uint32_t)(uint8_t)(color.b * 255.f) << 16 | (uint32_t)(uint8_t)color.a << 24;
+        memcpy(target.color + pos, &pixel, sizeof(pixel));
+        break;
+    }
+    case BlendMode::PREMULTIPLIED:
+    {
+        uint32_t inverseAlpha = 255 - (uint32_t)(color.a * 255.f + .5f);
+        for (uint32_t c = 0; c < 4; ++c)
+            target.color[pos + c] = (uint8_t)glm::min((uint32_t)(color[c] * 255.f) + multiplyUnorm8(target.color[pos + c], inverseAlpha), 255u);
+        break;
+    }
+    default:
+        target.color[pos + 0] = (uint8_t)((target.color[pos + 0] * (1.f - color.a)) + ((color.r * 255.f) * color.a));
+        target.color[pos + 1] = (uint8_t)((target.color[pos + 1] * (1.f - color.a)) + ((color.g * 255.f) * color.a));
+        target.color[pos + 2] = (uint8_t)((target.color[pos + 2] * (1.f - color.a)) + ((color.b * 255.f) * color.a));
+        target.color[pos + 3] = (uint8_t)color.a;
+        break;
+    }
+    return depthWritten;
+}
+
+/**
+ * Per fragment operations of covered lanes of a packet starting at pixel (x, y), lanes lie in one row of a block.
+ * Colors of all lanes are clamped and blended at once, results are same as from perFragmentOperations.
+ * The framebuffer is accessed only in covered lanes.
+ * @return true if depth was written
+ */
+bool packetFragmentOperations(RenderTarget& target, BlendMode blendMode, OutFragmentPacket const& outPacket, float const* depth, int x, int y, uint32_t coverage, bool depthTested)
+{
+    size_t first = pixelIndex(target, x, y);
+    float* targetDepth = target.depth + first;
+    uint32_t* targetColor = reinterpret_cast<uint32_t*>(target.color) + first;
+
+    if (!depthTested)
+    {
+        for (uint32_t lane = 0; lane < fragmentPacketSize; ++lane)
+            if ((coverage & (1u << lane)) && depth[lane] >= targetDepth[lane])
+                coverage &= ~(1u << lane);
+        if (!coverage)
+            return false;
+    }
+
+    alignas(16) uint32_t pixels[fragmentPacketSize] = {};
+    if (blendMode != BlendMode::DISABLED)
+        for (uint32_t lane = 0; lane < fragmentPacketSize; ++lane)
+            if (coverage & (1u << lane))
+                pixels[lane] = targetColor[lane];
+
+    static_assert(fragmentPacketSize == 8, "packet is processed as two groups of four lanes");
+    __m128 const zero = _mm_setzero_ps();
+    __m128 const one = _mm_set1_ps(1.f);
+    __m128 const scale = _mm_set1_ps(255.f);
+    __m128i const byteMask = _mm_set1_epi32(0xFF);
+
+    // channels of all lanes, 8-bit values (premultiplied sums up to 510) in 16-bit lanes
+    __m128i channels[4];
+    uint32_t depthMask = 0;
+    __m128i group[2][4];
+    __m128i inverseAlpha[2];
+    for (uint32_t g = 0; g < 2; ++g)
+    {
+        __m128 color[4];
+        for (uint32_t c = 0; c < 4; ++c)
+            color[c] = _mm_min_ps(one, _mm_max_ps(zero, _mm_loadu_ps(outPacket.gl_FragColor[c] + 4 * g)));
+        __m128 alpha = color[3];
+        depthMask |= _mm_movemask_ps(_mm_cmpgt_ps(alpha, _mm_set1_ps(.5f))) << (4 * g);
+
+        __m128i framebuffer = _mm_load_si128((__m128i const*)pixels + g);
+        switch (blendMode)
+        {
+        case BlendMode::DISABLED:
+            for (uint32_t c = 0; c < 3; ++c)
+                group[g][c] = _mm_cvttps_epi32(_mm_mul_ps(color[c], scale));
+            group[g][3] = _mm_cvttps_epi32(alpha);
+            break;
+        case BlendMode::PREMULTIPLIED:
+            for (uint32_t c = 0; c < 4; ++c)
+                group[g][c] = _mm_cvttps_epi32(_mm_mul_ps(color[c], scale));
+            inverseAlpha[g] = _mm_sub_epi32(byteMask, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(alpha, scale), _mm_set1_ps(.5f))));
+            break;
+        default:
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                __m128 destination = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(framebuffer, 8 * c), byteMask));
+                group[g][c] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(destination, _mm_sub_ps(one, alpha)), _mm_mul_ps(_mm_mul_ps(color[c], scale), alpha)));
+            }
+            group[g][3] = _mm_cvttps_epi32(alpha);
+            break;
+        }
+    }
+
+    for (uint32_t c = 0; c < 4; ++c)
+        channels[c] = _mm_packs_epi32(group[0][c], group[1][c]);
+
+    if (blendMode == BlendMode::PREMULTIPLIED)
+    {
+        // framebuffer * (1 - alpha) in 16-bit fixed point, see multiplyUnorm8
+        __m128i inverse = _mm_packs_epi32(inverseAlpha[0], inverseAlpha[1]);
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            __m128i destination = _mm_packs_epi32(
+                _mm_and_si128(_mm_srli_epi32(_mm_load_si128((__m128i const*)pixels), 8 * c), byteMask),
+                _mm_and_si128(_mm_srli_epi32(_mm_load_si128((__m128i const*)pixels + 1), 8 * c), byteMask));
+            __m128i product = _mm_add_epi16(_mm_mullo_epi16(destination, inverse), _mm_set1_epi16(128));
+            channels[c] = _mm_add_epi16(channels[c], _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8));
+        }
+    }
+
+    // saturate to bytes and interleave channels into rgba pixels
+    __m128i rg = _mm_unpacklo_epi8(_mm_packus_epi16(channels[0], channels[0]), _mm_packus_epi16(channels[1], channels[1]));
+    __m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(channels[2], channels[2]), _mm_packus_epi16(channels[3], channels[3]));
+    _mm_store_si128((__m128i*)pixels, _mm_unpacklo_epi16(rg, ba));
+    _mm_store_si128((__m128i*)pixels + 1, _mm_unpackhi_epi16(rg, ba));
+
+    for (uint32_t lane = 0; lane < fragmentPacketSize; ++lane)
+    {
+        if (!(coverage & (1u << lane)))
+            continue;
+        targetColor[lane] = pixels[lane];
+        if (depthMask & (1u << lane))
+            targetDepth[lane] = depth[lane];
+    }
+    return (coverage & depthMask) != 0;
+}
+
+float edgeFunction(OutVertex const& a, OutVertex const& b, OutVertex const& c)
+{
+    return (c.gl_Position.x - a.gl_Position.x) * (b.gl_Position.y - a.gl_Position.y) - (c.gl_Position.y - a.gl_Position.y) * (b.gl_Position.x - a.gl_Position.x);
+}
+
+/**
+ * Backface test in clip space, right after the vertex shader.
+ * Determinant of (x, y, w) of the points is the screen space area multiplied by w0*w1*w2.
+ * Its sign is the winding of the part of the triangle in front of the eye even if some w is negative,
+ * so triangles are culled before clipping and perspective division.
+ */
+bool isBackFacing(Triangle const& triangle, DrawState const& state)
+{
+    glm::vec4 const& a = triangle.points[0].gl_Position;
+    glm::vec4 const& b = triangle.points[1].gl_Position;
+    glm::vec4 const& c = triangle.points[2].gl_Position;
+    float det = glm::dot(glm::vec3(a.x, a.y, a.w), glm::cross(glm::vec3(b.x, b.y, b.w), glm::vec3(c.x, c.y, c.w)));
+    return det * state.frontFaceSign <= 0.f;
+}
+
+bool isTriangleVisible(Triangle const& triangle)
+{
+    // triangles without area cover no pixel
+    return edgeFunction(triangle.points[0], triangle.points[1], triangle.points[2]) != 0.f;
+}
+
+/**
+ * Pixels that can be covered by the triangle: (minX, minY, maxX, maxY), max is exclusive.
+ */
+glm::ivec4 triangleBounds(Triangle const& triangle, uint32_t width, uint32_t height)
+{
+    float min_x = glm::min(triangle.points[0].gl_Position.x, glm::min(triangle.points[1].gl_Position.x, triangle.points[2].gl_Position.x));
+    float min_y = glm::min(triangle.points[0].gl_Position.y, glm::min(triangle.points[1].gl_Position.y, triangle.points[2].gl_Position.y));
+
+    float max_x = glm::max(triangle.points[0].gl_Position.x, glm::max(triangle.points[1].gl_Position.x, triangle.points[2].gl_Position.x));
+    float max_y = glm::max(triangle.points[0].gl_Position.y, glm::max(triangle.points[1].gl_Position.y, triangle.points[2].gl_Position.y));
+
+    return glm::ivec4(
+        (int)glm::clamp(min_x, 0.f, (float)width),
+        (int)glm::clamp(min_y, 0.f, (float)height),
+        (int)glm::clamp(max_x + 1.f, 0.f, (float)width),
+        (int)glm::clamp(max_y + 1.f, 0.f, (float)height));
+}
+
+int const subPixelBits = 4;                         ///< screen positions are snapped to 1/16 of pixel (28.4 fixed point)
+int const subPixelScale = 1 << subPixelBits;
+int const pixelCenter = subPixelScale / 2;
+float const maxFixedCoordinate = (float)(1 << 18);  ///< farther vertices do not fit into the fixed point edge functions, see guard band
+
+/**
+ * Fixed point edge function of edge a->b: E(x, y) = a*x + b*y + c.
+ * Edges are oriented so that the inside of the triangle is positive for both windings.
+ * Pixel is covered when E > threshold, threshold is -1 for top-left edges (E >= 0) and 0 for the others (E > 0),
+ * so a pixel center lying exactly on an edge shared by two triangles belongs to only one of them.
+ */
+struct FixedEdge {
+    int64_t a, b, c;
+    int32_t threshold;
+    int32_t stepX;      // a * subPixelScale, change of E between neighbouring pixels
+    int32_t stepY;      // b * subPixelScale
+    __m128i laneSteps;  // (0, 1, 2, 3) * stepX
+};
+
+FixedEdge setupFixedEdge(glm::i64vec2 const& from, glm::i64vec2 const& to, int64_t orientation)
+{
+    FixedEdge edge;
+    edge.a = (from.y - to.y) * orientation;
+    edge.b = (to.x - from.x) * orientation;
+    edge.c = -(edge.a * from.x + edge.b * from.y);
+
+    // frame y grows upwards, so the top edge has inside of the triangle below it
+    bool topLeft = edge.a > 0 || (edge.a == 0 && edge.b < 0);
+    edge.threshold = topLeft ? -1 : 0;
+
+    edge.stepX = (int32_t)(edge.a * subPixelScale);
+    edge.stepY = (int32_t)(edge.b * subPixelScale);
+    edge.laneSteps = _mm_setr_epi32(0, edge.stepX, 2 * edge.stepX, 3 * edge.stepX);
+    return edge;
+}
+
+/**
+ * Value of edge function in the center of pixel (x, y).
+ */
+inline int64_t evaluateEdge(FixedEdge const& edge, int x, int y)
+{
+    return edge.a * ((int64_t)x * subPixelScale + pixelCenter) + edge.b * ((int64_t)y * subPixelScale + pixelCenter) + edge.c;
+}
+
+/**
+ * Value interpolated linearly in screen space: value in the center of origin pixel of the triangle
+ * and its change between neighbouring pixels.
+ */
+struct PlaneEquation {
+    double value;
+    float  dx;
+    float  dy;
+};
+
+uint32_t const maxPlanes = 2 + maxAttributes * 4;   ///< depth, 1/w and every float component of attributes divided by w
+
+/**
+ * Triangle prepared for rasterization into one render target.
+ * Attributes are interpolated perspective correctly as (attribute/w) / (1/w), both are planes in screen space.
+ */
+struct TriangleSetup {
+    DrawState const* state;
+    RenderTarget* target;
+    FixedEdge edges[3];                     // point[0] -> point[1], point[1] -> point[2], point[2] -> point[0]
+    int originX, originY;                   // corner of triangle bounds, does not depend on the render target
+    uint32_t nofPlanes;
+    PlaneEquation planes[maxPlanes];        // depth, 1/w, interpolated components / w
+    uint8_t components[maxAttributes * 4];  // attribute * 4 + component of every interpolated plane
+    uint32_t derivativePlane;               // first plane of Program::derivativeAttribute
+    uint32_t nofDerivativeComponents;       // 0 - the fragment shader does not get derivatives
+    InFragment flat;                        // fragment with integer attributes of the first point, they are not interpolated
+    uint32_t nofFlatComponents;
+    uint8_t flatComponents[maxAttributes * 4];  // attribute * 4 + component of every integer component
+    glm::ivec2 const* spans;                // covered pixels [x, y) of every row from spanOriginY, nullptr if coverage is tested per block
+    int spanOriginY;
+    bool useHiZ;                            // occluded blocks can be skipped
+    float nearest;                          // lower bound of fragment depth in the whole triangle
+    float margin;                           // covers rounding of interpolated depth
+};
+
+uint32_t const depthPlane = 0;
+uint32_t const invWPlane = 1;
+uint32_t const firstAttributePlane = 2;
+
+/**
+ * Plane through values f0, f1, f2 in the points of the triangle.
+ * Barycentric coordinates of the points 0 and 1 are edge functions 1 and 2 divided by the doubled area.
+ */
+PlaneEquation setupPlane(TriangleSetup const& setup, double area, double originE1, double originE2, float f0, float f1, float f2)
+{
+    double d0 = ((double)f0 - f2) / area;
+    double d1 = ((double)f1 - f2) / area;
+
+    PlaneEquation plane;
+    plane.value = f2 + d0 * originE1 + d1 * originE2;
+    plane.dx = (float)(d0 * setup.edges[1].stepX + d1 * setup.edges[2].stepX);
+    plane.dy = (float)(d0 * setup.edges[1].stepY + d1 * setup.edges[2].stepY);
+    return plane;
+}
+
+/**
+ * Plane value in the center of pixel (x, y).
+ */
+inline double evaluatePlane(TriangleSetup const& setup, PlaneEquation const& plane, int x, int y)
+{
+    return plane.value + (double)plane.dx * (x - setup.originX) + (double)plane.dy * (y - setup.originY);
+}
+
+void setupPlanes(TriangleSetup& setup, Triangle const& triangle, double area)
+{
+    OutVertex const& p0 = triangle.points[0];
+    OutVertex const& p1 = triangle.points[1];
+    OutVertex const& p2 = triangle.points[2];
+    Program const& prg = setup.state->prg;
+
+    double originE1 = (double)evaluateEdge(setup.edges[1], setup.originX, setup.originY);
+    double originE2 = (double)evaluateEdge(setup.edges[2], setup.originX, setup.originY);
+
+    // depth is linear in screen space, attributes are linear after division by w
+    glm::vec3 invW = 1.f / glm::vec3(p0.gl_Position.w, p1.gl_Position.w, p2.gl_Position.w);
+    setup.planes[depthPlane] = setupPlane(setup, area, originE1, originE2, p0.gl_Position.z, p1.gl_Position.z, p2.gl_Position.z);
+    setup.planes[invWPlane] = setupPlane(setup, area, originE1, originE2, invW[0], invW[1], invW[2]);
+    setup.nofPlanes = firstAttributePlane;
+
+    setup.flat = InFragment();
+    setup.nofFlatComponents = 0;
+    setup.nofDerivativeComponents = 0;
+
+    for (uint32_t i = 0; i < maxAttributes; ++i)
+    {
+        if ((uint32_t)prg.vs2fs[i] > (uint32_t)AttributeType::VEC4)
+        {
+            for (uint32_t c = 0; c < (uint32_t)prg.vs2fs[i] - 8; ++c)
+                setup.flatComponents[setup.nofFlatComponents++] = (uint8_t)(i * 4 + c);
+        }
+
+        switch (prg.vs2fs[i])
+        {
+        case AttributeType::UINT:
+            setup.flat.attributes[i].u1 = p0.attributes[i].u1;
+            continue;
+        case AttributeType::UVEC2:
+            setup.flat.attributes[i].u2 = p0.attributes[i].u2;
+            continue;
+        case AttributeType::UVEC3:
+            setup.flat.attributes[i].u3 = p0.attributes[i].u3;
+            continue;
+        case AttributeType::UVEC4:
+            setup.flat.attributes[i].u4 = p0.attributes[i].u4;
+            continue;
+        case AttributeType::EMPTY:
+            continue;
+        default:
+            break;
+        }
+
+        if ((int32_t)i == prg.derivativeAttribute)
+        {
+            setup.derivativePlane = setup.nofPlanes;
+            setup.nofDerivativeComponents = (uint32_t)prg.vs2fs[i];
+        }
+
+        // float attributes have as many components as is the value of their type
+        for (uint32_t c = 0; c < (uint32_t)prg.vs2fs[i]; ++c)
+        {
+            setup.components[setup.nofPlanes - firstAttributePlane] = (uint8_t)(i * 4 + c);
+            setup.planes[setup.nofPlanes++] = setupPlane(setup, area, originE1, originE2,
+                p0.attributes[i].v4[c] * invW[0], p1.attributes[i].v4[c] * invW[1], p2.attributes[i].v4[c] * invW[2]);
+        }
+    }
+}
+
+static_assert(rasterBlockSize <= fragmentPacketSize, "one row of a block has to fit into one fragment packet");
+
+/**
+ * Fragment path below is instantiated for common program configurations, see selectBlockRasterizer.
+ * NOF_PLANES is the number of interpolated planes (0 - taken from the setup),
+ * EARLY_Z is Program::earlyDepthTest.
+ */
+
+/**
+ * @param planes values of all planes for pixels of the row starting at x - lane, lane selects the pixel
+ * @return true if depth was written
+ */
+template<uint32_t NOF_PLANES, bool EARLY_Z>
+bool loadFragmentToShader(TriangleSetup const& setup, int x, int y, float const (*planes)[fragmentPacketSize], int lane)
+{
+    RenderTarget& target = *setup.target;
+    DrawState const& state = *setup.state;
+    uint32_t nofPlanes = NOF_PLANES ? NOF_PLANES : setup.nofPlanes;
+    float depth = planes[depthPlane][lane];
+
+    // EARLY DEPTH TEST, the depth test does not depend on output of the fragment shader,
+    // so occluded fragments can be discarded before attributes are interpolated and the shader runs
+    if (EARLY_Z && depth >= target.depth[pixelIndex(target, x, y)])
+        return false;
+
+    InFragment inFragment = setup.flat;
+    inFragment.gl_FragCoord.x = x + 0.5f;
+    inFragment.gl_FragCoord.y = y + 0.5f;
+    inFragment.gl_FragCoord.z = depth;
+
+    // perspective correct attributes
+    float w = 1.f / planes[invWPlane][lane];
+    for (uint32_t i = firstAttributePlane; i < nofPlanes; ++i)
+    {
+        uint32_t component = setup.components[i - firstAttributePlane];
+        inFragment.attributes[component >> 2].v4[component & 3] = planes[i][lane] * w;
+    }
+
+    // derivatives of the quotient (a / w) / (1 / w) follow from the plane gradients analytically
+    PlaneEquation const& invWGradient = setup.planes[invWPlane];
+    for (uint32_t c = 0; c < setup.nofDerivativeComponents; ++c)
+    {
+        PlaneEquation const& gradient = setup.planes[setup.derivativePlane + c];
+        float value = planes[setup.derivativePlane + c][lane] * w;
+        inFragment.dFdx[c] = (gradient.dx - value * invWGradient.dx) * w;
+        inFragment.dFdy[c] = (gradient.dy - value * invWGradient.dy) * w;
+    }
+
+    OutFragment outFragment;
+    state.prg.fragmentShader(outFragment, inFragment, state.si);
+
+    return perFragmentOperations(target, state.blendMode, outFragment, depth, x, y, EARLY_Z);
+}
+
+/**
+ * Runs batched fragment shader for covered pixels of one row starting at x.
+ * @return true if depth was written
+ */
+template<uint32_t NOF_PLANES, bool EARLY_Z>
+bool loadPacketToShader(TriangleSetup const& setup, int x, int y, float const (*planes)[fragmentPacketSize], uint32_t coverage)
+{
+    RenderTarget& target = *setup.target;
+    DrawState const& state = *setup.state;
+    uint32_t nofPlanes = NOF_PLANES ? NOF_PLANES : setup.nofPlanes;
+    float const* depth = planes[depthPlane];
+
+    if (EARLY_Z)
+    {
+        float const* targetDepth = target.depth + pixelIndex(target, x, y);
+        for (uint32_t lane = 0; lane < fragmentPacketSize; ++lane)
+            if ((coverage & (1u << lane)) && depth[lane] >= targetDepth[lane])
+                coverage &= ~(1u << lane);
+        if (!coverage)
+            return false;
+    }
+
+    InFragmentPacket packet;
+    packet.coverage = coverage;
+    for (uint32_t lane = 0; lane < fragmentPacketSize; ++lane)
+    {
+        packet.gl_FragCoord[0][lane] = x + lane + 0.5f;
+        packet.gl_FragCoord[1][lane] = y + 0.5f;
+        packet.gl_FragCoord[2][lane] = depth[lane];
+        packet.gl_FragCoord[3][lane] = 1.f;
+    }
+
+    // integer attributes are same for the whole triangle
+    for (uint32_t i = 0; i < setup.nofFlatComponents; ++i)
+    {
+        uint32_t component = setup.flatComponents[i];
+        uint32_t value = setup.flat.attributes[component >> 2].u4[component & 3];
+        for (uint32_t lane = 0; lane < fragmentPacketSize; ++lane)
+            packet.attributes[component >> 2].u[component & 3][lane] = value;
+    }
+
+    // perspective correct attributes
+    alignas(32) float w[fragmentPacketSize];
+    for (uint32_t lane = 0; lane < fragmentPacketSize; ++lane)
+        w[lane] = 1.f / planes[invWPlane][lane];
+
+    for (uint32_t i = firstAttributePlane; i < nofPlanes; ++i)
+    {
+        uint32_t component = setup.components[i - firstAttributePlane];
+        float* lanes = packet.attributes[component >> 2].v[component & 3];
+        for (uint32_t lane = 0; lane < fragmentPacketSize; ++lane)
+            lanes[lane] = planes[i][lane] * w[lane];
+    }
+
+    PlaneEquation const& invWGradient = setup.planes[invWPlane];
+    for (uint32_t c = 0; c < setup.nofDerivativeComponents; ++c)
+    {
+        PlaneEquation const& gradient = setup.planes[setup.derivativePlane + c];
+        float const* values = planes[setup.derivativePlane + c];
+        for (uint32_t lane = 0; lane < fragmentPacketSize; ++lane)
+        {
+            float value = values[lane] * w[lane];
+            packet.dFdx[c][lane] = (gradient.dx - value * invWGradient.dx) * w[lane];
+            packet.dFdy[c][lane] = (gradient.dy - value * invWGradient.dy) * w[lane];
+        }
+    }
+
+    OutFragmentPacket outPacket;
+    state.prg.fragmentPacketShader(outPacket, packet, state.si);
+
+    return packetFragmentOperations(target, state.blendMode, outPacket, depth, x, y, coverage, EARLY_Z);
+}
+
+/**
+ * Rasterizes pixels [x0, x1) x [y0, y1), coverage is tested for 4 pixels per step.
+ * Only edges in testedEdges (bit per edge) cross the block, the block lies inside of the others.
+ * Edge values of crossing edges stay small inside of the block, so their coverage is tested in 32-bit integers.
+ * Planes are evaluated in the first pixel of the block and stepped by multiply-adds inside of it.
+ * Covered pixels of one row go to the batched fragment shader at once, if the program has one (PACKETS).
+ */
+template<uint32_t NOF_PLANES, bool EARLY_Z, bool PACKETS>
+bool rasterizeBlock(TriangleSetup const& setup, int x0, int y0, int x1, int y1, int testedEdges)
+{
+    FixedEdge const* edges = setup.edges;
+    uint32_t nofPlanes = NOF_PLANES ? NOF_PLANES : setup.nofPlanes;
+
+    int64_t rowStart[3];
+    for (int i = 0; i < 3; ++i)
+        rowStart[i] = evaluateEdge(edges[i], x0, y0);
+
+    float blockStart[maxPlanes];
+    for (uint32_t i = 0; i < nofPlanes; ++i)
+        blockStart[i] = (float)evaluatePlane(setup, setup.planes[i], x0, y0);
+
+    __m128 const laneIndices = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    alignas(16) float planes[maxPlanes][fragmentPacketSize];
+
+    bool depthWritten = false;
+
+    for (int y = y0; y < y1; y++)
+    {
+        // coverage of the whole row of the block, bit per pixel
+        uint32_t coverage = 0;
+        if (setup.spans)
+        {
+            glm::ivec2 span = setup.spans[y - setup.spanOriginY];
+            int start = glm::max(span.x, x0) - x0;
+            int end = glm::min(span.y, x1) - x0;
+            if (start < end)
+                coverage = ((1u << end) - 1) & ~((1u << start) - 1);
+        }
+        else for (int x = x0; x < x1; x += 4)
+        {
+            int groupCoverage = 0xF;
+            for (int i = 0; i < 3; ++i)
+            {
+                if (!(testedEdges & (1 << i)))
+                    continue;
+                int64_t value = rowStart[i] + (int64_t)edges[i].stepX * (x - x0);
+                __m128i lanes = _mm_add_epi32(_mm_set1_epi32((int32_t)value), edges[i].laneSteps);
+                groupCoverage &= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(lanes, _mm_set1_epi32(edges[i].threshold))));
+            }
+            coverage |= groupCoverage << (x - x0);
+        }
+        coverage &= (1u << (x1 - x0)) - 1;
+
+        for (int i = 0; i < 3; ++i)
+            rowStart[i] += edges[i].stepY;
+
+        if (!coverage)
+            continue;
+
+        float offsetY = (float)(y - y0);
+        for (uint32_t i = 0; i < nofPlanes; ++i)
+        {
+            PlaneEquation const& plane = setup.planes[i];
+            __m128 row = _mm_set1_ps(blockStart[i] + plane.dy * offsetY);
+            __m128 dx = _mm_set1_ps(plane.dx);
+            for (uint32_t lane = 0; lane < fragmentPacketSize; lane += 4)
+                _mm_store_ps(planes[i] + lane, _mm_add_ps(row, _mm_mul_ps(_mm_add_ps(laneIndices, _mm_set1_ps((float)lane)), dx)));
+        }
+
+        if (PACKETS)
+        {
+            depthWritten |= loadPacketToShader<NOF_PLANES, EARLY_Z>(setup, x0, y, planes, coverage);
+            continue;
+        }
+
+        for (int lane = 0; lane < x1 - x0; ++lane)
+        {
+            if (coverage & (1u << lane))
+                depthWritten |= loadFragmentToShader<NOF_PLANES, EARLY_Z>(setup, x0 + lane, y, planes, lane);
+        }
+    }
+
+    return depthWritten;
+}
+
+template<uint32_t NOF_PLANES>
+BlockRasterizer blockRasterizer(bool earlyDepthTest, bool packets)
+{
+    if (earlyDepthTest)
+        return packets ? rasterizeBlock<NOF_PLANES, true, true> : rasterizeBlock<NOF_PLANES, true, false>;
+    return packets ? rasterizeBlock<NOF_PLANES, false, true> : rasterizeBlock<NOF_PLANES, false, false>;
+}
+
+/**
+ * Picks the block rasterizer instance matching the program.
+ * Programs interpolating up to 8 float components get loops with compile-time trip counts, others use the generic one.
+ */
+BlockRasterizer selectBlockRasterizer(Program const& prg)
+{
+    uint32_t nofPlanes = firstAttributePlane;
+    for (uint32_t i = 0; i < maxAttributes; ++i)
+        if ((uint32_t)prg.vs2fs[i] <= (uint32_t)AttributeType::VEC4)
+            nofPlanes += (uint32_t)prg.vs2fs[i];
+
+    bool earlyDepthTest = prg.earlyDepthTest;
+    bool packets = prg.fragmentPacketShader != nullptr;
+
+    switch (nofPlanes)
+    {
+    case 2:  return blockRasterizer<2>(earlyDepthTest, packets);
+    case 3:  return blockRasterizer<3>(earlyDepthTest, packets);
+    case 4:  return blockRasterizer<4>(earlyDepthTest, packets);
+    case 5:  return blockRasterizer<5>(earlyDepthTest, packets);
+    case 6:  return blockRasterizer<6>(earlyDepthTest, packets);
+    case 7:  return blockRasterizer<7>(earlyDepthTest, packets);
+    case 8:  return blockRasterizer<8>(earlyDepthTest, packets);
+    case 9:  return blockRasterizer<9>(earlyDepthTest, packets);
+    case 10: return blockRasterizer<10>(earlyDepthTest, packets);
+    default: return blockRasterizer<0>(earlyDepthTest, packets);
+    }
+}
+
+/**
+ * Floor of n / d for d > 0.
+ */
+inline int64_t floorDivide(int64_t n, int64_t d)
+{
+    int64_t q = n / d;
+    return q - (n % d != 0 && n < 0);
+}
+
+/**
+ * Covered pixels [start, end) of row y, computed exactly from the edge functions.
+ */
+glm::ivec2 scanlineSpan(FixedEdge const* edges, int y, int minX, int maxX)
+{
+    int64_t start = minX;
+    int64_t end = maxX;
+    for (int i = 0; i < 3; ++i)
+    {
+        // inside is value + stepX * (x - minX) > threshold
+        FixedEdge const& edge = edges[i];
+        int64_t limit = edge.threshold - evaluateEdge(edge, minX, y);
+        if (edge.stepX > 0)
+            start = glm::max(start, minX + floorDivide(limit, edge.stepX) + 1);
+        else if (edge.stepX < 0)
+            end = glm::min(end, minX - floorDivide(limit, -(int64_t)edge.stepX));
+        else if (limit >= 0)
+            return glm::ivec2(minX, minX);
+    }
+    return start < end ? glm::ivec2((int)start, (int)end) : glm::ivec2(minX, minX);
+}
+
+int const spanTriangleArea = 32 * 32;  ///< triangles with larger bounds are rasterized by scanline spans instead of edge tests
+
+int const smallTriangleSize = 4;    ///< triangles whose pixel centers fit into 4x4 pixels are tested for coverage before plane setup
+
+/**
+ * Coverage of pixels [x0, x1) x [y0, y1) of a small triangle, bit (x - x0) + (y - y0) * smallTriangleSize.
+ */
+uint32_t smallTriangleCoverage(FixedEdge const* edges, int x0, int y0, int x1, int y1)
+{
+    uint32_t coverage = 0;
+    for (int y = y0; y < y1; ++y)
+        for (int x = x0; x < x1; ++x)
+        {
+            bool inside = true;
+            for (int i = 0; i < 3; ++i)
+                inside &= evaluateEdge(edges[i], x, y) > edges[i].threshold;
+            coverage |= (uint32_t)inside << ((x - x0) + (y - y0) * smallTriangleSize);
+        }
+    return coverage;
+}
+
+/**
+ * Margin covering rounding of depth interpolated inside of triangle with vertex depths z.
+ */
+float depthMargin(glm::vec3 const& z)
+{
+    return 16.f * std::numeric_limits<float>::epsilon() * glm::max(abs(z.x), glm::max(abs(z.y), abs(z.z)));
+}
+
+void rasterize(Triangle const& triangle, DrawState const& state, RenderTarget& target, glm::ivec4 const& bounds)
+{
+    glm::i64vec2 points[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        glm::vec4 const& position = triangle.points[i].gl_Position;
+        if (!(abs(position.x) < maxFixedCoordinate && abs(position.y) < maxFixedCoordinate))
+            return; // only invalid (NaN) positions get here, clipping keeps triangles inside of the guard band
+
+        points[i] = glm::i64vec2(std::lround(position.x * subPixelScale), std::lround(position.y * subPixelScale));
+    }
+
+    // pixels whose centers lie in the snapped bounding box, tiny triangles often contain none of them
+    glm::i64vec2 lowest = glm::min(points[0], glm::min(points[1], points[2]));
+    glm::i64vec2 highest = glm::max(points[0], glm::max(points[1], points[2]));
+    glm::i64vec2 firstCenter = (lowest - (int64_t)pixelCenter + (int64_t)(subPixelScale - 1)) >> (int64_t)subPixelBits;
+    glm::i64vec2 lastCenter = (highest - (int64_t)pixelCenter) >> (int64_t)subPixelBits;
+
+    // only the part of bounding box covered by render target
+    int min_x = glm::max(bounds.x, glm::max(target.minX, (int)firstCenter.x));
+    int min_y = glm::max(bounds.y, glm::max(target.minY, (int)firstCenter.y));
+    int max_x = glm::min(bounds.z, glm::min(target.maxX, (int)lastCenter.x + 1));
+    int max_y = glm::min(bounds.w, glm::min(target.maxY, (int)lastCenter.y + 1));
+    if (min_x >= max_x || min_y >= max_y)
+        return;
+
+    TriangleSetup setup;
+    setup.state = &state;
+    setup.target = &target;
+    setup.originX = bounds.x;
+    setup.originY = bounds.y;
+
+    // doubled area of snapped triangle, its sign is the winding (cw or ccw)
+    int64_t triangleArea = (points[1].x - points[0].x) * (points[2].y - points[0].y) - (points[1].y - points[0].y) * (points[2].x - points[0].x);
+    if (triangleArea == 0)
+        return;
+    int64_t orientation = triangleArea > 0 ? 1 : -1;
+
+    // EDGE FUNCTIONS are evaluated from integer pixel coordinates, so the result does not depend on where the render target starts.
+    setup.edges[0] = setupFixedEdge(points[0], points[1], orientation);
+    setup.edges[1] = setupFixedEdge(points[1], points[2], orientation);
+    setup.edges[2] = setupFixedEdge(points[2], points[0], orientation);
+
+    // SMALL TRIANGLES, their few pixels are tested at once and triangles covering none of them skip the setup of planes
+    if (max_x - min_x <= smallTriangleSize && max_y - min_y <= smallTriangleSize && !smallTriangleCoverage(setup.edges, min_x, min_y, max_x, max_y))
+        return;
+
+    setupPlanes(setup, triangle, (double)(triangleArea * orientation));
+
+    HierarchicalDepth* hiZ = target.hiZ;
+    PlaneEquation const& depth = setup.planes[depthPlane];
+
+    // HIERARCHICAL Z, fragments are discarded before the fragment shader, so whole occluded triangle or block can be skipped
+    glm::vec3 z = glm::vec3(triangle.points[0].gl_Position.z, triangle.points[1].gl_Position.z, triangle.points[2].gl_Position.z);
+    setup.useHiZ = hiZ && state.prg.earlyDepthTest;
+    setup.margin = depthMargin(z) + 16.f * std::numeric_limits<float>::epsilon() * rasterBlockSize * (abs(depth.dx) + abs(depth.dy));
+    setup.nearest = glm::min(z.x, glm::min(z.y, z.z)) - setup.margin;
+
+    if (setup.useHiZ)
+    {
+        float farthest = -std::numeric_limits<float>::infinity();
+        for (int ty = min_y / (int)tileSize; ty <= (max_y - 1) / (int)tileSize; ++ty)
+            for (int tx = min_x / (int)tileSize; tx <= (max_x - 1) / (int)tileSize; ++tx)
+                farthest = glm::max(farthest, hiZ->tiles[tx + ty * hiZ->tilesX]);
+        if (setup.nearest >= farthest)
+            return;
+    }
+
+    // SCANLINE SPANS of large triangles, empty space around the triangle is never tested
+    thread_local std::vector<glm::ivec2> spans;
+    setup.spans = nullptr;
+    setup.spanOriginY = min_y;
+    if ((max_x - min_x) * (max_y - min_y) >= spanTriangleArea)
+    {
+        spans.resize(max_y - min_y);
+        for (int y = min_y; y < max_y; ++y)
+            spans[y - min_y] = scanlineSpan(setup.edges, y, min_x, max_x);
+        setup.spans = spans.data();
+    }
+
+    bool depthWritten = false;
+
+    int const blockMask = ~(int)(rasterBlockSize - 1);
+
+    // blocks are aligned to the frame, edge functions are tested in extreme corner pixel of the block
+    for (int by = min_y & blockMask; by < max_y; by += rasterBlockSize)
+    {
+        int y0 = glm::max(by, min_y);
+        int y1 = glm::min(by + (int)rasterBlockSize, max_y);
+
+        // with spans only blocks touching some span of this row of blocks are visited
+        int rowMinX = min_x;
+        int rowMaxX = max_x;
+        if (setup.spans)
+        {
+            rowMinX = max_x;
+            rowMaxX = min_x;
+            for (int y = y0; y < y1; ++y)
+            {
+                glm::ivec2 span = setup.spans[y - min_y];
+                if (span.x >= span.y)
+                    continue;
+                rowMinX = glm::min(rowMinX, span.x);
+                rowMaxX = glm::max(rowMaxX, span.y);
+            }
+        }
+
+        for (int bx = rowMinX & blockMask; bx < rowMaxX; bx += rasterBlockSize)
+        {
+            int x0 = glm::max(bx, min_x);
+            int x1 = glm::min(bx + (int)rasterBlockSize, max_x);
+
+            bool rejected = false;
+            int testedEdges = 0;
+            for (int i = 0; i < 3 && !setup.spans; ++i)
+            {
+                FixedEdge const& edge = setup.edges[i];
+                int64_t corner = evaluateEdge(edge, x0, y0);
+                int64_t spanX = (int64_t)edge.stepX * (x1 - 1 - x0);
+                int64_t spanY = (int64_t)edge.stepY * (y1 - 1 - y0);
+                int64_t minValue = corner + glm::min(spanX, int64_t(0)) + glm::min(spanY, int64_t(0));
+                int64_t maxValue = corner + glm::max(spanX, int64_t(0)) + glm::max(spanY, int64_t(0));
+
+                rejected |= maxValue <= edge.threshold;     // whole block is outside of this edge
+                if (minValue <= edge.threshold)             // block is not completely inside of this edge
+                    testedEdges |= 1 << i;
+            }
+
+            if (rejected)
+                continue;
+
+            uint32_t block = hiZ ? bx / rasterBlockSize + by / rasterBlockSize * hiZ->blocksX : 0;
+            if (setup.useHiZ)
+            {
+                // depth is linear in screen space, its minimum over the block is in one of the corners
+                double nearest = evaluatePlane(setup, depth, x0, y0);
+                nearest += glm::min((double)depth.dx * (x1 - 1 - x0), 0.) + glm::min((double)depth.dy * (y1 - 1 - y0), 0.);
+                if (glm::max(setup.nearest, (float)nearest - setup.margin) >= hiZ->blocks[block])
+                    continue;
+            }
+
+            // FAST CLEAR, pending clear of the block is written before its first fragment
+            if (target.clears && pendingBlock(*target.clears, bx, by))
+                fillPendingBlock(target, *target.clears, bx, by);
+
+            if (state.rasterizeBlock(setup, x0, y0, x1, y1, testedEdges) && hiZ)
+            {
+                // tighten farthest depth of the block, the render target covers the whole block
+                int w = glm::min(bx + (int)rasterBlockSize, target.maxX) - bx;
+                int h = glm::min(by + (int)rasterBlockSize, target.maxY) - by;
+                hiZ->blocks[block] = farthestDepth(target, bx, by, w, h);
+                depthWritten = true;
+            }
+        }
+    }
+
+    if (depthWritten)
+    {
+        for (int ty = min_y / (int)tileSize; ty <= (max_y - 1) / (int)tileSize; ++ty)
+            for (int tx = min_x / (int)tileSize; tx <= (max_x - 1) / (int)tileSize; ++tx)
+                updateHierarchicalTile(*hiZ, tx, ty);
+    }
+}
+
+/**
+ * Moves point a towards point b, t is the parameter of the intersection.
+ */
+void cutEdge(OutVertex& a, OutVertex const& b, float t, Program const& prg)
+{
+    a.gl_Position += t * (b.gl_Position - a.gl_Position);
+
+    for (uint32_t i = 0; i < maxAttributes; i++)
+    {
+        switch (prg.vs2fs[i])
+        {
+        case AttributeType::FLOAT:
+            a.attributes[i].v1 += t * (b.attributes[i].v1 - a.attributes[i].v1);
+            continue;
+        case AttributeType::VEC2:
+            a.attributes[i].v2 += t * (b.attributes[i].v2 - a.attributes[i].v2);
+            continue;
+        case AttributeType::VEC3:
+            a.attributes[i].v3 += t * (b.attributes[i].v3 - a.attributes[i].v3);
+            continue;
+        case AttributeType::VEC4:
+            a.attributes[i].v4 += t * (b.attributes[i].v4 - a.attributes[i].v4);
+            continue;
+        case AttributeType::UINT:
+            a.attributes[i].u1 += (uint32_t)t * (b.attributes[i].u1 - a.attributes[i].u1);
+            continue;
+        case AttributeType::UVEC2:
+            a.attributes[i].u2 += (uint32_t)t * (b.attributes[i].u2 - a.attributes[i].u2);
+            continue;
+        case AttributeType::UVEC3:
+            a.attributes[i].u3 += (uint32_t)t * (b.attributes[i].u3 - a.attributes[i].u3);
+            continue;
+        case AttributeType::UVEC4:
+            a.attributes[i].u4 += (uint32_t)t * (b.attributes[i].u4 - a.attributes[i].u4);
+            continue;
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * Clip space region of the triangles that are rasterized without clipping.
+ * Guard band is much wider than the screen, it only keeps screen positions inside of the fixed point range,
+ * so only triangles crossing the near plane or the guard band are clipped.
+ * Depth beyond the far plane is not clipped, it is left to the depth test.
+ */
+struct ClipVolume {
+    __m128    guardBandScale;   // (1/Gx, 1/Gy, 1, 1), guard band is |x| <= Gx*w, |y| <= Gy*w
+    glm::vec4 planes[8];        // signed distance of clip planes, indexed by bit of the clip code
+};
+
+ClipVolume createClipVolume(uint32_t halfWidth, uint32_t halfHeight)
+{
+    float guardBandX = 0.5f * maxFixedCoordinate / glm::max(halfWidth, 1u);
+    float guardBandY = 0.5f * maxFixedCoordinate / glm::max(halfHeight, 1u);
+
+    ClipVolume volume;
+    volume.guardBandScale = _mm_setr_ps(1.f / guardBandX, 1.f / guardBandY, 1.f, 1.f);
+    volume.planes[0] = glm::vec4(+1.f, 0.f, 0.f, guardBandX);   // left
+    volume.planes[1] = glm::vec4(0.f, +1.f, 0.f, guardBandY);   // bottom
+    volume.planes[2] = glm::vec4(0.f, 0.f, +1.f, 1.f);          // near
+    volume.planes[3] = glm::vec4(0.f);
+    volume.planes[4] = glm::vec4(-1.f, 0.f, 0.f, guardBandX);   // right
+    volume.planes[5] = glm::vec4(0.f, -1.f, 0.f, guardBandY);   // top
+    volume.planes[6] = glm::vec4(0.f);                          // far plane is not clipped
+    volume.planes[7] = glm::vec4(0.f);
+    return volume;
+}
+
+/**
+ * Outcode of clip space position: x < -w, y < -w, z < -w in bits 0-2, x > w, y > w in bits 4-5.
+ */
+inline int clipCode(__m128 position)
+{
+    __m128 w = _mm_shuffle_ps(position, position, _MM_SHUFFLE(3, 3, 3, 3));
+    int below = _mm_movemask_ps(_mm_cmplt_ps(position, _mm_sub_ps(_mm_setzero_ps(), w)));
+    int above = _mm_movemask_ps(_mm_cmpgt_ps(position, w));
+    return (below & 0x7) | ((above & 0x3) << 4);
+}
+
+/**
+ * Convex polygon produced by clipping of one triangle, every clip plane adds at most one point.
+ */
+struct ClippedPolygon {
+    OutVertex points[3 + 5];
+    uint32_t  nofPoints;
+};
+
+/**
+ * Clips triangle against the clip planes in planeMask (Sutherland-Hodgman).
+ */
+void clipTriangle(Triangle const& triangle, int planeMask, ClipVolume const& volume, Program const& prg, ClippedPolygon& polygon)
+{
+    ClippedPolygon other;
+    ClippedPolygon* input = &other;
+    ClippedPolygon* output = &polygon;
+
+    for (uint32_t i = 0; i < 3; ++i)
+        output->points[i] = triangle.points[i];
+    output->nofPoints = 3;
+
+    for (int plane = 0; plane < 8; ++plane)
+    {
+        if (!(planeMask & (1 << plane)))
+            continue;
+
+        std::swap(input, output);
+        output->nofPoints = 0;
+
+        for (uint32_t i = 0; i < input->nofPoints; ++i)
+        {
+            OutVertex const& current = input->points[i];
+            OutVertex const& next = input->points[(i + 1) % input->nofPoints];
+            float currentDistance = glm::dot(volume.planes[plane], current.gl_Position);
+            float nextDistance = glm::dot(volume.planes[plane], next.gl_Position);
+
+            if (currentDistance >= 0)
+                output->points[output->nofPoints++] = current;
+
+            if ((currentDistance >= 0) != (nextDistance >= 0))
+            {
+                // intersection is the outside point moved towards the inside one
+                OutVertex const& outside = currentDistance < 0 ? current : next;
+                OutVertex const& inside = currentDistance < 0 ? next : current;
+                float outsideDistance = glm::min(currentDistance, nextDistance);
+                float insideDistance = glm::max(currentDistance, nextDistance);
+
+                OutVertex& intersection = output->points[output->nofPoints++];
+                intersection = outside;
+                cutEdge(intersection, inside, outsideDistance / (outsideDistance - insideDistance), prg);
+            }
+        }
+
+        if (output->nofPoints < 3)
+        {
+            output->nofPoints = 0;
+            break;
+        }
+    }
+
+    if (output != &polygon)
+        polygon = *output;
+}
+
+void finishVertex(OutVertex& vertex, uint32_t halfWidth, uint32_t halfHeight)
+{
+    perspectiveDivision(vertex);
+    viewportTransformation(vertex, halfWidth, halfHeight);
+}
+
+uint32_t const vertexBatchSize = 3 * 4096;   ///< number of vertices transformed by one run of the vertex stage
+uint32_t const vertexJobSize = 3 * 64;       ///< number of vertices transformed by one job of the parallel vertex stage
+
+static_assert(vertexJobSize % vertexPacketSize == 0, "jobs of the vertex stage have to consist of whole packets");
+
+/**
+ * Vertex stage: runs vertex shader for nofVertices invocations, i-th result is written to outVertices[i].
+ * Programs with a batched vertex shader are run packet by packet.
+ * Without a pool the shader is invoked in order on the calling thread.
+ */
+template<typename INVOCATION>
+void vertexStage(VertexFetchPlan const& plan, uint32_t drawID, DrawState const& state, uint32_t nofVertices, INVOCATION const& invocation, OutVertex* outVertices, ThreadPool* pool)
+{
+    auto transform = [&](uint32_t begin, uint32_t end) {
+        if (state.prg.vertexPacketShader)
+        {
+            for (uint32_t i = begin; i < end; i += vertexPacketSize)
+                runVertexPacketShader(outVertices, plan, drawID, invocation, i, glm::min(vertexPacketSize, end - i), state.si, state.prg);
+            return;
+        }
+        for (uint32_t i = begin; i < end; ++i)
+            runVertexShader(outVertices[i], plan, drawID, invocation(i), state.si, state.prg);
+    };
+
+    if (!pool)
+    {
+        transform(0, nofVertices);
+        return;
+    }
+
+    uint32_t nofJobs = (nofVertices + vertexJobSize - 1) / vertexJobSize;
+    pool->parallelFor(nofJobs, [&](uint32_t job, uint32_t) {
+        uint32_t begin = job * vertexJobSize;
+        transform(begin, glm::min(begin + vertexJobSize, nofVertices));
+    });
+}
+
+uint32_t const emptySlot = 0xffffffffu;
+
+/**
+ * Post-transform vertex cache of one indexed draw.
+ * Every gl_VertexID is transformed once, later occurrences reuse the stored vertex.
+ */
+struct VertexCache {
+    std::vector<uint32_t>  slots;       // gl_VertexID -> index into vertices (or emptySlot)
+    std::vector<OutVertex> vertices;    // transformed vertices in order of first occurrence
+    std::vector<uint32_t>  misses;      // shader invocations that have to be transformed in current batch
+};
+
+/**
+ * Looks up batch of invocations in the cache, transforms only vertices that are not cached yet.
+ * vertexSlots[i] receives index into cache.vertices for invocation firstVertex + i.
+ */
+void cachedVertexStage(GPUMemory& mem, VertexFetchPlan const& plan, uint32_t drawID, DrawState const& state, uint32_t firstVertex, uint32_t nofVertices, VertexCache& cache, uint32_t* vertexSlots, ThreadPool* pool)
+{
+    uint32_t firstNewSlot = (uint32_t)cache.vertices.size();
+    cache.misses.clear();
+
+    for (uint32_t i = 0; i < nofVertices; ++i)
+    {
+        uint32_t invocation = firstVertex + i;
+        uint32_t vertexID = computeVertexID(plan, invocation);
+
+        if (vertexID >= cache.slots.size())
+            cache.slots.resize(glm::max<size_t>(vertexID + 1, cache.slots.size() * 2), emptySlot);
+
+        uint32_t& slot = cache.slots[vertexID];
+        if (slot == emptySlot)
+        {
+            slot = firstNewSlot + (uint32_t)cache.misses.size();
+            cache.misses.push_back(invocation);
+        }
+
+        vertexSlots[i] = slot;
+    }
+
+    mem.statistics.vertexCacheLookups += nofVertices;
+    mem.statistics.vertexCacheHits += nofVertices - cache.misses.size();
+
+    cache.vertices.resize(firstNewSlot + cache.misses.size());
+    vertexStage(plan, drawID, state, (uint32_t)cache.misses.size(), [&](uint32_t i) { return cache.misses[i]; }, cache.vertices.data() + firstNewSlot, pool);
+}
+
+/**
+ * Screen of the draw, shared by all triangles going through the primitive stage.
+ */
+struct Viewport {
+    uint32_t   halfWidth;
+    uint32_t   halfHeight;
+    ClipVolume volume;
+};
+
+Viewport createViewport(Frame const& frame)
+{
+    Viewport viewport;
+    viewport.halfWidth = frame.width >> 1;
+    viewport.halfHeight = frame.height >> 1;
+    viewport.volume = createClipVolume(viewport.halfWidth, viewport.halfHeight);
+    return viewport;
+}
+
+/**
+ * Runs vertex stage of the draw in batches, batch(vertices, vertexSlots, nofVertices) receives every batch in submission order.
+ * Triangle i of the batch consists of vertices[vertexSlots[3 * i + k]].
+ */
+template<typename BATCH>
+void vertexBatches(GPUMemory& mem, DrawCommand& cmd, uint32_t drawID, DrawState const& state, ThreadPool* pool, BATCH&& batch)
+{
+    VertexFetchPlan plan = createVertexFetchPlan(mem, cmd.vao);
+
+    uint32_t nofVertices = (cmd.nofVertices / 3) * 3;
+    bool useCache = mem.settings.vertexCache && cmd.vao.indexBufferID >= 0;
+
+    std::vector<OutVertex> outVertices;
+    std::vector<uint32_t> vertexSlots(glm::min(nofVertices, vertexBatchSize));
+    VertexCache cache;
+
+    if (!useCache)
+    {
+        outVertices.resize(vertexSlots.size());
+        for (uint32_t i = 0; i < vertexSlots.size(); ++i)
+            vertexSlots[i] = i;
+    }
+
+    for (uint32_t firstVertex = 0; firstVertex < nofVertices; firstVertex += vertexBatchSize)
+    {
+        uint32_t batchSize = glm::min(vertexBatchSize, nofVertices - firstVertex);
+
+        if (useCache)
+            cachedVertexStage(mem, plan, drawID, state, firstVertex, batchSize, cache, vertexSlots.data(), pool);
+        else
+            vertexStage(plan, drawID, state, batchSize, [&](uint32_t i) { return firstVertex + i; }, outVertices.data(), pool);
+
+        batch(useCache ? cache.vertices.data() : outVertices.data(), vertexSlots.data(), batchSize);
+    }
+}
+
+/**
+ * Primitive stage: culling, clipping, perspective division and viewport transformation of one assembled triangle.
+ * Every visible screen space triangle (clipped triangle may turn into more of them) is passed to emit.
+ */
+template<typename EMIT>
+void primitiveStage(Triangle& triangle, DrawState const& state, Viewport const& viewport, EMIT&& emit)
+{
+    if (state.backfaceCulling && isBackFacing(triangle, state))
+        return;
+
+    int frustumCodes = ~0;
+    int guardBandCodes = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        __m128 position = _mm_loadu_ps(&triangle.points[i].gl_Position.x);
+        frustumCodes &= clipCode(position);
+        guardBandCodes |= clipCode(_mm_mul_ps(position, viewport.volume.guardBandScale));
+    }
+
+    // whole triangle is outside of one frustum plane (side planes or near plane)
+    if (frustumCodes)
+        return;
+
+    if (!guardBandCodes)
+    {
+        for (auto& point : triangle.points)
+            finishVertex(point, viewport.halfWidth, viewport.halfHeight);
+        if (isTriangleVisible(triangle))
+            emit(triangle);
+        return;
+    }
+
+    // CLIPPING NEEDED, the polygon is rasterized as a fan of triangles
+    ClippedPolygon polygon;
+    clipTriangle(triangle, guardBandCodes, viewport.volume, state.prg, polygon);
+
+    for (uint32_t i = 0; i < polygon.nofPoints; ++i)
+        finishVertex(polygon.points[i], viewport.halfWidth, viewport.halfHeight);
+
+    for (uint32_t i = 1; i + 1 < polygon.nofPoints; ++i)
+    {
+        Triangle fan;
+        fan.points[0] = polygon.points[0];
+        fan.points[1] = polygon.points[i];
+        fan.points[2] = polygon.points[i + 1];
+        if (isTriangleVisible(fan))
+            emit(fan);
+    }
+}
+
+/**
+ * Front end of the pipeline: vertex stage and primitive stage.
+ * Every visible screen space triangle is passed to emit in submission order.
+ */
+template<typename EMIT>
+void draw(GPUMemory& mem, DrawCommand& cmd, uint32_t drawID, DrawState& state, ThreadPool* pool, EMIT&& emit)
+{
+    Viewport viewport = createViewport(mem.framebuffer);
+
+    vertexBatches(mem, cmd, drawID, state, pool, [&](OutVertex const* vertices, uint32_t const* vertexSlots, uint32_t nofVertices) {
+        for (uint32_t triangleIndex = 0; triangleIndex < nofVertices / 3; triangleIndex++)
+        {
+            Triangle triangle = primitiveAssembly(vertices, vertexSlots, triangleIndex);
+            primitiveStage(triangle, state, viewport, emit);
+        }
+    });
+}
+
+////////////////////////////////////////////////////////////////
+// TILED EXECUTION
+uint32_t const maxBinnedTriangles = 1u << 16;   ///< bins are flushed when this many triangles are waiting
+
+struct BinnedTriangle {
+    Triangle   triangle;
+    glm::ivec4 bounds;
+    uint32_t   drawIndex;
+};
+
+/**
+ * Screen space triangles sorted into screen tiles.
+ * Every bin keeps indices into triangles in submission order.
+ */
+struct TileBins {
+    RenderTarget                       frame;
+    HierarchicalDepth*                 hiZ = nullptr;
+    uint32_t                           tilesX = 0;
+    uint32_t                           tilesY = 0;
+    std::vector<DrawState>             draws;
+    std::vector<BinnedTriangle>        triangles;
+    std::vector<std::vector<uint32_t>> bins;
+};
+
+/**
+ * Local copy of one tile, small enough to stay in cache of the worker.
+ */
+struct TileBuffer {
+    std::vector<uint8_t> color;
+    std::vector<float>   depth;
+};
+
+void initTileBins(TileBins& tiles, RenderTarget const& frame)
+{
+    tiles.frame = frame;
+    tiles.hiZ = frame.hiZ;
+    tiles.tilesX = (frame.maxX + tileSize - 1) / tileSize;
+    tiles.tilesY = (frame.maxY + tileSize - 1) / tileSize;
+    tiles.bins.resize(tiles.tilesX * tiles.tilesY);
+}
+
+void binTriangle(TileBins& tiles, Triangle const& triangle, uint32_t drawIndex)
+{
+    glm::ivec4 bounds = triangleBounds(triangle, tiles.frame.maxX, tiles.frame.maxY);
+    if (bounds.x >= bounds.z || bounds.y >= bounds.w)
+        return;
+
+    uint32_t index = (uint32_t)tiles.triangles.size();
+    tiles.triangles.push_back({ triangle, bounds, drawIndex });
+
+    for (int ty = bounds.y / tileSize; ty <= (bounds.w - 1) / (int)tileSize; ++ty)
+        for (int tx = bounds.x / tileSize; tx <= (bounds.z - 1) / (int)tileSize; ++tx)
+            tiles.bins[ty * tiles.tilesX + tx].push_back(index);
+}
+
+void rasterizeTile(TileBins& tiles, uint32_t tile, TileBuffer& buffer)
+{
+    RenderTarget const& frame = tiles.frame;
+    uint32_t channels = frame.channels;
+
+    int32_t minX = (tile % tiles.tilesX) * tileSize;
+    int32_t minY = (tile / tiles.tilesX) * tileSize;
+    glm::ivec4 area = glm::ivec4(minX, minY, glm::min(minX + (int32_t)tileSize, frame.maxX), glm::min(minY + (int32_t)tileSize, frame.maxY));
+
+    buffer.color.resize(tileSize * tileSize * channels);
+    buffer.depth.resize(tileSize * tileSize);
+    RenderTarget target = linearRenderTarget(buffer.color.data(), buffer.depth.data(), channels, tileSize, area);
+    target.hiZ = tiles.hiZ;
+
+    // load tile, blocks waiting for a clear are filled instead of loaded
+    for (int y = area.y; y < area.w; y += rasterBlockSize)
+        for (int x = area.x; x < area.z; x += rasterBlockSize)
+        {
+            uint8_t pending = frame.clears ? pendingBlock(*frame.clears, x, y) : 0;
+            if (pending != (pendingColor | pendingDepth))
+                copyPixels(target, frame, x, y, glm::min(x + (int)rasterBlockSize, area.z), glm::min(y + (int)rasterBlockSize, area.w));
+            if (pending)
+                fillPendingBlock(target, *frame.clears, x, y);
+        }
+
+    for (uint32_t index : tiles.bins[tile])
+    {
+        BinnedTriangle const& binned = tiles.triangles[index];
+        rasterize(binned.triangle, tiles.draws[binned.drawIndex], target, binned.bounds);
+    }
+
+    // write tile back
+    copyPixels(frame, target, area.x, area.y, area.z, area.w);
+}
+
+void flushTileBins(TileBins& tiles, ThreadPool& pool)
+{
+    if (tiles.triangles.empty())
+        return;
+
+    std::vector<uint32_t> usedTiles;
+    for (uint32_t tile = 0; tile < tiles.bins.size(); ++tile)
+        if (!tiles.bins[tile].empty())
+            usedTiles.push_back(tile);
+
+    std::vector<TileBuffer> buffers(pool.getNofThreads());
+    pool.parallelFor((uint32_t)usedTiles.size(), [&](uint32_t job, uint32_t thread) {
+        rasterizeTile(tiles, usedTiles[job], buffers[thread]);
+    });
+
+    tiles.triangles.clear();
+    for (auto& bin : tiles.bins)
+        bin.clear();
+}
+////////////////////////////////////////////////////////////////
+
+/**
+ * With fast clear the values are only recorded and pixels are written later, see PendingClears.
+ */
+void clear(RenderTarget& frame, ClearCommand& cmd) {
+    // storage of both layouts ends with the last pixel, padding of blocks in between is cleared as well
+    size_t nofPixels = frame.maxX > 0 && frame.maxY > 0 ? pixelIndex(frame, frame.maxX - 1, frame.maxY - 1) + 1 : 0;
+    uint8_t pending = 0;
+
+    if (cmd.clearColor) {
+        uint32_t combinedValue = 0;
+        combinedValue |= ((uint32_t)(cmd.color.r * 255.f));
+        combinedValue |= ((uint32_t)(cmd.color.g * 255.f)) << 8;
+        combinedValue |= ((uint32_t)(cmd.color.b * 255.f)) << 16;
+        combinedValue |= ((uint32_t)(cmd.color.a * 255.f)) << 24;
+
+        if (frame.clears)
+            frame.clears->color = combinedValue;
+        else
+            streamFill(reinterpret_cast<uint32_t*>(frame.color), nofPixels, combinedValue);
+        pending |= pendingColor;
+    }
+    if (cmd.clearDepth)
+    {
+        uint32_t depthBits;
+        memcpy(&depthBits, &cmd.depth, sizeof(float));
+        if (frame.clears)
+            frame.clears->depth = cmd.depth;
+        else
+            streamFill(reinterpret_cast<uint32_t*>(frame.depth), nofPixels, depthBits);
+        pending |= pendingDepth;
+        clearHierarchicalDepth(*frame.hiZ, cmd.depth);
+    }
+
+    if (frame.clears)
+        for (auto& block : frame.clears->blocks)
+            block |= pending;
+}
+
+void executeSerial(GPUMemory& mem, CommandBuffer& cb, RenderTarget frame)
+{
+    // depth may be changed outside of the gpu between executions
+    HierarchicalDepth hiZ;
+    buildHierarchicalDepth(hiZ, frame);
+    frame.hiZ = &hiZ;
+
+    PendingClears clears;
+    initPendingClears(clears, frame);
+    frame.clears = mem.settings.fastClear ? &clears : nullptr;
+
+    uint32_t drawID = 0;
+
+    for (uint32_t i = 0; i < cb.nofCommands; ++i) {
+        CommandType type = cb.commands[i].type;
+        CommandData data = cb.commands[i].data;
+        if (type == CommandType::CLEAR)
+            clear(frame, data.clearCommand);
+        if (type == CommandType::DRAW)
+        {
+            DrawState state = createDrawState(mem, data.drawCommand);
+            draw(mem, data.drawCommand, drawID, state, nullptr, [&](Triangle const& triangle) {
+                rasterize(triangle, state, frame, triangleBounds(triangle, mem.framebuffer.width, mem.framebuffer.height));
+            });
+            drawID++;
+        }
+    }
+
+    resolvePendingClears(frame);
+}
+
+/**
+ * Vertex stage runs in parallel, triangles of all draws are binned into screen tiles, tiles are rasterized in parallel.
+ * Triangles inside one tile are rasterized in submission order, so the result is same as in executeSerial.
+ */
+void executeTiled(GPUMemory& mem, CommandBuffer& cb, RenderTarget frame)
+{
+    ThreadPool& pool = getThreadPool(mem.settings.nofThreads);
+
+    HierarchicalDepth hiZ;
+    buildHierarchicalDepth(hiZ, frame);
+    frame.hiZ = &hiZ;
+
+    PendingClears clears;
+    initPendingClears(clears, frame);
+    frame.clears = mem.settings.fastClear ? &clears : nullptr;
+
+    TileBins tiles;
+    initTileBins(tiles, frame);
+
+    uint32_t drawID = 0;
+
+    for (uint32_t i = 0; i < cb.nofCommands; ++i) {
+        CommandType type = cb.commands[i].type;
+        CommandData data = cb.commands[i].data;
+        if (type == CommandType::CLEAR)
+        {
+            flushTileBins(tiles, pool);
+            clear(frame, data.clearCommand);
+        }
+        if (type == CommandType::DRAW)
+        {
+            uint32_t drawIndex = (uint32_t)tiles.draws.size();
+            tiles.draws.push_back(createDrawState(mem, data.drawCommand));
+            draw(mem, data.drawCommand, drawID, tiles.draws.back(), &pool, [&](Triangle const& triangle) {
+                binTriangle(tiles, triangle, drawIndex);
+                if (tiles.triangles.size() >= maxBinnedTriangles)
+                    flushTileBins(tiles, pool);
+            });
+            drawID++;
+        }
+    }
+
+    flushTileBins(tiles, pool);
+    resolvePendingClears(frame);
+}
+
+////////////////////////////////////////////////////////////////
+// PIPELINED EXECUTION
+uint32_t const nofPipelineBatches = 4;      ///< vertex batches in flight between the vertex and the primitive stage
+uint32_t const triangleQueueSize = 256;     ///< triangles in flight between the primitive stage and the rasterizer
+
+/**
+ * Work passed down the pipeline. Commands other than draws travel through all stages,
+ * so they stay ordered with triangles. CommandType::EMPTY ends the pipeline.
+ */
+struct BatchItem {
+    CommandType type;
+    uint32_t    command;        // index into the command buffer
+    uint32_t    drawIndex;
+    uint32_t    batch;          // index of the vertex batch buffer
+    uint32_t    nofVertices;
+};
+
+struct TriangleItem {
+    CommandType type;
+    uint32_t    command;
+    uint32_t    drawIndex;
+    Triangle    triangle;
+};
+
+struct Pipeline {
+    std::vector<DrawState>                         draws;
+    std::vector<OutVertex>                         batches[nofPipelineBatches];
+    SpscQueue<uint32_t, nofPipelineBatches>        freeBatches;   // primitive stage -> vertex stage
+    SpscQueue<BatchItem, nofPipelineBatches>       vertexQueue;   // vertex stage -> primitive stage
+    SpscQueue<TriangleItem, triangleQueueSize>     triangleQueue; // primitive stage -> rasterizer
+};
+
+/**
+ * Vertex assembly and vertex shader of all draws, transformed vertices of every batch are stored in triangle order.
+ */
+void runVertexThread(GPUMemory& mem, CommandBuffer& cb, Pipeline& pipeline)
+{
+    uint32_t drawIndex = 0;
+    for (uint32_t i = 0; i < cb.nofCommands; ++i)
+    {
+        Command& command = cb.commands[i];
+        if (command.type == CommandType::EMPTY)
+            continue;
+
+        if (command.type != CommandType::DRAW)
+        {
+            pipeline.vertexQueue.back() = { command.type, i, 0, 0, 0 };
+            pipeline.vertexQueue.push();
+            continue;
+        }
+
+        DrawState const& state = pipeline.draws[drawIndex];
+        vertexBatches(mem, command.data.drawCommand, drawIndex, state, nullptr, [&](OutVertex const* vertices, uint32_t const* vertexSlots, uint32_t nofVertices) {
+            uint32_t batch = pipeline.freeBatches.front();
+            pipeline.freeBatches.pop();
+
+            OutVertex* batchVertices = pipeline.batches[batch].data();
+            for (uint32_t v = 0; v < nofVertices; ++v)
+                batchVertices[v] = vertices[vertexSlots[v]];
+
+            pipeline.vertexQueue.back() = { CommandType::DRAW, i, drawIndex, batch, nofVertices };
+            pipeline.vertexQueue.push();
+        });
+        drawIndex++;
+    }
+
+    pipeline.vertexQueue.back() = { CommandType::EMPTY, 0, 0, 0, 0 };
+    pipeline.vertexQueue.push();
+}
+
+/**
+ * Primitive assembly, culling, clipping and viewport transformation.
+ */
+void runPrimitiveThread(Frame const& frame, Pipeline& pipeline)
+{
+    Viewport viewport = createViewport(frame);
+
+    for (;;)
+    {
+        BatchItem item = pipeline.vertexQueue.front();
+        pipeline.vertexQueue.pop();
+
+        if (item.type != CommandType::DRAW)
+        {
+            TriangleItem& command = pipeline.triangleQueue.back();
+            command.type = item.type;
+            command.command = item.command;
+            pipeline.triangleQueue.push();
+            if (item.type == CommandType::EMPTY)
+                return;
+            continue;
+        }
+
+        DrawState const& state = pipeline.draws[item.drawIndex];
+        OutVertex const* vertices = pipeline.batches[item.batch].data();
+        for (uint32_t v = 0; v + 2 < item.nofVertices; v += 3)
+        {
+            Triangle triangle = { { vertices[v], vertices[v + 1], vertices[v + 2] } };
+            primitiveStage(triangle, state, viewport, [&](Triangle const& visible) {
+                TriangleItem& out = pipeline.triangleQueue.back();
+                out.type = CommandType::DRAW;
+                out.command = item.command;
+                out.drawIndex = item.drawIndex;
+                out.triangle = visible;
+                pipeline.triangleQueue.push();
+            });
+        }
+
+        pipeline.freeBatches.back() = item.batch;
+        pipeline.freeBatches.push();
+    }
+}
+
+/**
+ * Vertex stage, primitive stage and rasterization with fragment processing run concurrently on three threads,
+ * connected by lock-free queues. Rasterization consumes triangles in submission order, so the result is same as in executeSerial.
+ * Waits on the queues are added to GPUStatistics, they show which stage is the bottleneck.
+ */
+void executePipelined(GPUMemory& mem, CommandBuffer& cb, RenderTarget frame)
+{
+    HierarchicalDepth hiZ;
+    buildHierarchicalDepth(hiZ, frame);
+    frame.hiZ = &hiZ;
+
+    PendingClears clears;
+    initPendingClears(clears, frame);
+    frame.clears = mem.settings.fastClear ? &clears : nullptr;
+
+    auto pipeline = std::make_unique<Pipeline>();
+    for (uint32_t i = 0; i < cb.nofCommands; ++i)
+        if (cb.commands[i].type == CommandType::DRAW)
+            pipeline->draws.push_back(createDrawState(mem, cb.commands[i].data.drawCommand));
+
+    for (uint32_t b = 0; b < nofPipelineBatches; ++b)
+    {
+        pipeline->batches[b].resize(vertexBatchSize);
+        pipeline->freeBatches.back() = b;
+        pipeline->freeBatches.push();
+    }
+
+    std::thread vertexThread([&]() { runVertexThread(mem, cb, *pipeline); });
+    std::thread primitiveThread([&]() { runPrimitiveThread(mem.framebuffer, *pipeline); });
+
+    for (;;)
+    {
+        TriangleItem& item = pipeline->triangleQueue.front();
+        if (item.type == CommandType::EMPTY)
+            break;
+
+        if (item.type == CommandType::CLEAR)
+            clear(frame, cb.commands[item.command].data.clearCommand);
+        else
+            rasterize(item.triangle, pipeline->draws[item.drawIndex], frame, triangleBounds(item.triangle, mem.framebuffer.width, mem.framebuffer.height));
+
+        pipeline->triangleQueue.pop();
+    }
+
+    vertexThread.join();
+    primitiveThread.join();
+    resolvePendingClears(frame);
+
+    // vertex stage waiting for a free batch waits for the primitive stage as well
+    mem.statistics.vertexQueueFullWaits += pipeline->vertexQueue.getNofFullWaits() + pipeline->freeBatches.getNofEmptyWaits();
+    mem.statistics.vertexQueueEmptyWaits += pipeline->vertexQueue.getNofEmptyWaits();
+    mem.statistics.triangleQueueFullWaits += pipeline->triangleQueue.getNofFullWaits();
+    mem.statistics.triangleQueueEmptyWaits += pipeline->triangleQueue.getNofEmptyWaits();
+}
+
+void execute(GPUMemory& mem, CommandBuffer& cb, RenderTarget const& frame)
+{
+    switch (mem.settings.mode)
+    {
+    case ExecutionMode::TILED:
+        executeTiled(mem, cb, frame);
+        break;
+    case ExecutionMode::PIPELINED:
+        executePipelined(mem, cb, frame);
+        break;
+    default:
+        executeSerial(mem, cb, frame);
+        break;
+    }
+}
+
+/**
+ * @return true if the first command overwrites whole color and depth buffer, so the previous content is not needed
+ */
+bool startsWithFullClear(CommandBuffer const& cb)
+{
+    for (uint32_t i = 0; i < cb.nofCommands; ++i)
+    {
+        Command const& command = cb.commands[i];
+        if (command.type == CommandType::EMPTY)
+            continue;
+        return command.type == CommandType::CLEAR && command.data.clearCommand.clearColor && command.data.clearCommand.clearDepth;
+    }
+    return false;
+}
+
+/**
+ * Commands run in the mode of GPUSettings::mode (serial, tiled or pipelined, see execute).
+ * With GPUSettings::blockedFramebuffer they render into a blocked copy of the frame that is resolved to rows at the end,
+ * otherwise directly into the row-major frame.
+ */
+//! [gpu_execute]
+void gpu_execute(GPUMemory& mem, CommandBuffer& cb) {
+    if (!mem.settings.blockedFramebuffer)
+    {
+        execute(mem, cb, frameRenderTarget(mem.framebuffer));
+        return;
+    }
+
+    // BLOCKED FRAMEBUFFER, the frame is converted to blocks, rendered and resolved back to rows
+    Frame& frame = mem.framebuffer;
+    uint32_t blocksX = (frame.width + rasterBlockSize - 1) / rasterBlockSize;
+    uint32_t blocksY = (frame.height + rasterBlockSize - 1) / rasterBlockSize;
+    thread_local std::vector<uint32_t> blockedColor;
+    thread_local std::vector<float> blockedDepth;
+    blockedColor.resize((size_t)blocksX * blocksY * blockPixels * frame.channels / sizeof(uint32_t));
+    blockedDepth.resize((size_t)blocksX * blocksY * blockPixels);
+
+    RenderTarget linear = frameRenderTarget(frame);
+    RenderTarget blocked = blockedRenderTarget((uint8_t*)blockedColor.data(), blockedDepth.data(), frame.channels, frame.width, frame.height);
+    if (!startsWithFullClear(cb))
+        copyPixels(blocked, linear, 0, 0, frame.width, frame.height);
+
+    execute(mem, cb, blocked);
+
+    copyPixels(linear, blocked, 0, 0, frame.width, frame.height);
+}
+//! [gpu_execute]
+
+/**
+ * Thread of the gpu executing asynchronously submitted command buffers one by one in submission order.
+ */
+class SubmissionQueue
+{
+public:
+    SubmissionQueue() : worker([this]() { workerLoop(); }) {}
+
+    ~SubmissionQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wakeUp.notify_one();
+        worker.join();
+    }
+
+    GPUFence submit(GPUMemory& mem, CommandBuffer& cb)
+    {
+        std::packaged_task<void()> task([&mem, &cb]() { gpu_execute(mem, cb); });
+        GPUFence fence = task.get_future().share();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wakeUp.notify_one();
+        return fence;
+    }
+
+private:
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::packaged_task<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this]() { return stop || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex                             mutex;
+    std::condition_variable                wakeUp;
+    std::deque<std::packaged_task<void()>> tasks;
+    bool                                   stop = false;
+    std::thread                            worker;
+};
+
+GPUFence gpu_execute_async(GPUMemory& mem, CommandBuffer& cb)
+{
+    static SubmissionQueue queue;
+    return queue.submit(mem, cb);
+}
+
+/**
+ * Nearest texel of one texture level, uv wraps around.
+ */
+glm::vec4 readTexel(uint8_t const* data, uint32_t width, uint32_t height, uint32_t channels, glm::vec2 uv)
+{
+    glm::vec2 uv1 = glm::fract(uv);
+    glm::vec2 uv2 = uv1 * glm::vec2(width - 1, height - 1) + 0.5f;
+    glm::uvec2 pix = glm::uvec2(uv2);
+
+    //auto t   = glm::fract(uv2);
+    glm::vec4 color = glm::vec4(0.f, 0.f, 0.f, 1.f);
+    uint32_t index = (pix.y * width + pix.x) * channels;
+
+    for (uint8_t c = 0; c < channels; ++c)
+        color[c] = data[index + c] * 0.00392156863f; // equal to "/255.f"
+
+    return color;
+}
+
+glm::vec4 readTexels(Texture const& texture, uint32_t level, glm::vec2 uv);
+
+/**
+ * @brief This function reads color from texture.
+ * Texture without row-major data is read from the base level of its texels.
+ *
+ * @param texture texture
+ * @param uv uv coordinates
+ *
+ * @return color 4 floats
+ */
+glm::vec4 read_texture(Texture const& texture, glm::vec2 uv) {
+    if (!texture.data)
+        return texture.texels ? readTexels(texture, 0, uv) : glm::vec4(0.f);
+
+    return readTexel(texture.data, texture.width, texture.height, texture.channels, uv);
+}
+
+/**
+ * Offset of level in row-major data in bytes, levels are stored one after another (see generate_mipmaps).
+ */
+size_t rowMajorLevelOffset(Texture const& texture, uint32_t level)
+{
+    size_t offset = 0;
+    for (uint32_t l = 0; l < level; ++l)
+        offset += (size_t)glm::max(texture.width >> l, 1u) * glm::max(texture.height >> l, 1u) * texture.channels;
+    return offset;
+}
+
+/**
+ * Squared length of the longer of the pixel axes in texels of the base level.
+ */
+float textureFootprint(Texture const& texture, glm::vec2 dUVdx, glm::vec2 dUVdy)
+{
+    glm::vec2 size = glm::vec2(texture.width, texture.height);
+    return glm::max(glm::dot(dUVdx * size, dUVdx * size), glm::dot(dUVdy * size, dUVdy * size));
+}
+
+/**
+ * Mipmap level whose texels match the footprint of a pixel (see textureFootprint),
+ * log2 of the longer of the pixel axes in texels rounded to the nearest level.
+ */
+uint32_t textureLevel(Texture const& texture, float footprint)
+{
+    // log2 of the squared footprint is twice the level, level l is chosen above footprint 2^(l - 0.5)
+    if (!(footprint > 2.f))
+        return 0;
+    return (uint32_t)glm::min(glm::log2(footprint) * 0.5f + 0.5f, (float)(texture.nofLevels - 1));
+}
+
+/**
+ * @brief This function reads color from the mipmap level of texture that matches the footprint of a pixel.
+ *
+ * @param texture texture
  * @param uv uv coordinates
+ * @param dUVdx derivative of uv in screen space x
+ * @param dUVdy derivative of uv in screen space y
  *
  * @return color 4 floats
  */
-glm::vec4 read_texture(Texture const& texture, glm::vec2 uv) {
+glm::vec4 read_texture(Texture const& texture, glm::vec2 uv, glm::vec2 dUVdx, glm::vec2 dUVdy) {
+    uint32_t level = textureLevel(texture, textureFootprint(texture, dUVdx, dUVdy));
     if (!texture.data)
-        return glm::vec4(0.f);
+        return texture.texels ? readTexels(texture, level, uv) : glm::vec4(0.f);
 
-    glm::vec2 uv1 = glm::fract(uv);
-    glm::vec2 uv2 = uv1 * glm::vec2(texture.width - 1, texture.height - 1) + 0.5f;
-    glm::uvec2 pix = glm::uvec2(uv2);
+    // levels of tiled texels (see tile_texture) need not exist in row-major data, they are read by sample_texture
+    if (level == 0 || texture.texels)
+        return readTexel(texture.data, texture.width, texture.height, texture.channels, uv);
 
-    //auto t   = glm::fract(uv2);
-    glm::vec4 color = glm::vec4(0.f, 0.f, 0.f, 1.f);
-    uint32_t index = (pix.y * texture.width + pix.x) * texture.channels;
+    return readTexel(texture.data + rowMajorLevelOffset(texture, level), glm::max(texture.width >> level, 1u), glm::max(texture.height >> level, 1u), texture.channels, uv);
+}
 
-    for (uint8_t c = 0; c < texture.channels; ++c)
-        color[c] = texture.data[index + c] * 0.00392156863f; // equal to "/255.f"
+/**
+ * Number of levels of the full mipmap chain of texture of size width x height.
+ */
+uint32_t fullMipmapLevels(uint32_t width, uint32_t height)
+{
+    uint32_t nofLevels = 1;
+    while (nofLevels < maxTextureLevels && (width >> nofLevels || height >> nofLevels))
+        nofLevels++;
+    return nofLevels;
+}
 
-    return color;
+/**
+ * @brief This function generates mipmap levels of texture, every texel averages 2x2 texels of the previous level.
+ * All levels are stored in one allocation one after another, the base level is copied to its beginning.
+ *
+ * @param texture texture, its data points to the generated levels and nofLevels is set
+ *
+ * @return storage of all levels, it has to live as long as the texture is used
+ */
+std::vector<uint8_t> generate_mipmaps(Texture& texture) {
+    texture.nofLevels = 1;
+    if (!texture.data || !texture.width || !texture.height)
+        return {};
+
+    uint32_t nofLevels = fullMipmapLevels(texture.width, texture.height);
+    size_t baseSize = (size_t)texture.width * texture.height * texture.channels;
+    texture.nofLevels = nofLevels;
+    std::vector<uint8_t> storage(rowMajorLevelOffset(texture, nofLevels));
+    std::copy(texture.data, texture.data + baseSize, storage.data());
+
+    uint8_t const* src = storage.data();
+    uint8_t* dst = storage.data() + baseSize;
+    uint32_t channels = texture.channels;
+    for (uint32_t level = 1; level < nofLevels; ++level)
+    {
+        uint32_t srcWidth = glm::max(texture.width >> (level - 1), 1u);
+        uint32_t srcHeight = glm::max(texture.height >> (level - 1), 1u);
+        uint32_t width = glm::max(texture.width >> level, 1u);
+        uint32_t height = glm::max(texture.height >> level, 1u);
+
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            // odd sizes drop the last row or column, a side of one texel is reused
+            uint32_t y0 = glm::min(2 * y, srcHeight - 1);
+            uint32_t y1 = glm::min(2 * y + 1, srcHeight - 1);
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                uint32_t x0 = glm::min(2 * x, srcWidth - 1);
+                uint32_t x1 = glm::min(2 * x + 1, srcWidth - 1);
+                for (uint32_t c = 0; c < channels; ++c)
+                {
+                    uint32_t sum = src[(y0 * srcWidth + x0) * channels + c] + src[(y0 * srcWidth + x1) * channels + c]
+                                 + src[(y1 * srcWidth + x0) * channels + c] + src[(y1 * srcWidth + x1) * channels + c];
+                    dst[(y * width + x) * channels + c] = (uint8_t)((sum + 2) >> 2);
+                }
+            }
+        }
+
+        src = dst;
+        dst += (size_t)width * height * channels;
+    }
+
+    texture.data = storage.data();
+    return storage;
+}
+
+/**
+ * Index of texel (x, y) in a level stored in 4x4 tiles, tiles of the level are stored in rows.
+ */
+inline uint32_t tiledTexelIndex(uint32_t x, uint32_t y, uint32_t tilesX)
+{
+    return (((y >> 2) * tilesX + (x >> 2)) << 4) | ((y & 3) << 2) | (x & 3);
+}
+
+/**
+ * Sets offsets of levels stored in 4x4 blocks of blockSize 32-bit words.
+ * @return size of all levels in 32-bit words
+ */
+size_t setBlockLevelOffsets(Texture& texture, uint32_t blockSize)
+{
+    size_t size = 0;
+    for (uint32_t level = 0; level < texture.nofLevels; ++level)
+    {
+        texture.levelOffsets[level] = (uint32_t)size;
+        size += (size_t)((glm::max(texture.width >> level, 1u) + 3) >> 2) * ((glm::max(texture.height >> level, 1u) + 3) >> 2) * blockSize;
+    }
+    return size;
+}
+
+/**
+ * Texel of row-major data packed into RGBA8, missing channels are 0, missing alpha is 255.
+ */
+uint32_t packTexel(uint8_t const* texel, uint32_t channels)
+{
+    uint8_t rgba[4] = { 0, 0, 0, 255 };
+    for (uint32_t c = 0; c < glm::min(channels, 4u); ++c)
+        rgba[c] = texel[c];
+    return rgba[0] | rgba[1] << 8 | rgba[2] << 16 | (uint32_t)rgba[3] << 24;
+}
+
+/**
+ * Texel of the next mipmap level that averages 2x2 RGBA8 texels, rounding is same as in generate_mipmaps.
+ */
+inline uint32_t averageTexels(uint32_t t00, uint32_t t01, uint32_t t10, uint32_t t11)
+{
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8)
+    {
+        uint32_t sum = ((t00 >> shift) & 255) + ((t01 >> shift) & 255) + ((t10 >> shift) & 255) + ((t11 >> shift) & 255);
+        result |= ((sum + 2) >> 2) << shift;
+    }
+    return result;
+}
+
+/**
+ * @brief This function copies texture into RGBA8 texels stored in 4x4 tiles and builds their full mipmap chain.
+ * Texels of one bilinear footprint are mostly in one tile, so they share a cache line.
+ * Missing channels are read as 0, missing alpha as 255, same as read_texture does.
+ * Mipmaps are box filtered from the previous tiled level, row-major mipmaps are not needed.
+ *
+ * @param texture texture, its nofLevels, texels, levelOffsets and format are set
+ *
+ * @return storage of the tiled texels
+ */
+std::vector<uint32_t> tile_texture(Texture& texture) {
+    texture.texels = nullptr;
+    if (!texture.data || !texture.width || !texture.height)
+        return {};
+
+    texture.nofLevels = fullMipmapLevels(texture.width, texture.height);
+    std::vector<uint32_t> storage(setBlockLevelOffsets(texture, 16));
+
+    uint32_t* base = storage.data();
+    uint32_t baseTilesX = (texture.width + 3) >> 2;
+    for (uint32_t y = 0; y < texture.height; ++y)
+        for (uint32_t x = 0; x < texture.width; ++x)
+            base[tiledTexelIndex(x, y, baseTilesX)] = packTexel(texture.data + (y * texture.width + x) * texture.channels, texture.channels);
+
+    for (uint32_t level = 1; level < texture.nofLevels; ++level)
+    {
+        uint32_t const* src = storage.data() + texture.levelOffsets[level - 1];
+        uint32_t* dst = storage.data() + texture.levelOffsets[level];
+        uint32_t srcWidth = glm::max(texture.width >> (level - 1), 1u);
+        uint32_t srcHeight = glm::max(texture.height >> (level - 1), 1u);
+        uint32_t srcTilesX = (srcWidth + 3) >> 2;
+        uint32_t width = glm::max(texture.width >> level, 1u);
+        uint32_t height = glm::max(texture.height >> level, 1u);
+        uint32_t tilesX = (width + 3) >> 2;
+
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            uint32_t y0 = glm::min(2 * y, srcHeight - 1);
+            uint32_t y1 = glm::min(2 * y + 1, srcHeight - 1);
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                uint32_t x0 = glm::min(2 * x, srcWidth - 1);
+                uint32_t x1 = glm::min(2 * x + 1, srcWidth - 1);
+                dst[tiledTexelIndex(x, y, tilesX)] = averageTexels(
+                    src[tiledTexelIndex(x0, y0, srcTilesX)], src[tiledTexelIndex(x1, y0, srcTilesX)],
+                    src[tiledTexelIndex(x0, y1, srcTilesX)], src[tiledTexelIndex(x1, y1, srcTilesX)]);
+            }
+        }
+    }
+
+    texture.texels = storage.data();
+    texture.format = TextureFormat::RGBA8;
+    return storage;
+}
+
+/**
+ * RGB888 color of 16-bit RGB565 color, the high bits are replicated into the low ones.
+ */
+inline glm::ivec3 expandColor565(uint32_t color)
+{
+    uint32_t r = (color >> 11) & 31;
+    uint32_t g = (color >> 5) & 63;
+    uint32_t b = color & 31;
+    return glm::ivec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+inline uint32_t packColor565(glm::ivec3 color)
+{
+    return (uint32_t)((color.r * 31 + 127) / 255) << 11 | (uint32_t)((color.g * 63 + 127) / 255) << 5 | (uint32_t)((color.b * 31 + 127) / 255);
+}
+
+/**
+ * Color of index of BC1 color block with endpoints c0 and c1.
+ * Four-color blocks interpolate two colors between the endpoints, three-color blocks (c0 <= c1 in BC1) one color and black.
+ */
+inline glm::ivec3 blockColor(uint32_t c0, uint32_t c1, uint32_t index, bool fourColors)
+{
+    glm::ivec3 e0 = expandColor565(c0);
+    glm::ivec3 e1 = expandColor565(c1);
+    switch (index)
+    {
+    case 0:  return e0;
+    case 1:  return e1;
+    case 2:  return fourColors ? (2 * e0 + e1) / 3 : (e0 + e1) / 2;
+    default: return fourColors ? (e0 + 2 * e1) / 3 : glm::ivec3(0);
+    }
+}
+
+/**
+ * Alpha of index of BC3 alpha block with endpoints a0 > a1, six alphas are interpolated between them.
+ * Blocks with a0 <= a1 interpolate four alphas and add 0 and 255.
+ */
+inline uint32_t blockAlpha(uint32_t a0, uint32_t a1, uint32_t index)
+{
+    if (index < 2)
+        return index ? a1 : a0;
+    if (a0 > a1)
+        return ((8 - index) * a0 + (index - 1) * a1) / 7;
+    if (index < 6)
+        return ((6 - index) * a0 + (index - 1) * a1) / 5;
+    return index == 6 ? 0 : 255;
+}
+
+/**
+ * RGBA8 texel i of BC1 color block, alpha is 255. Color blocks of BC3 (bc3) always have four colors.
+ */
+inline uint32_t decodeColorBlock(uint32_t const* block, uint32_t i, bool bc3)
+{
+    // weights of the endpoints in halves (three colors) or thirds (four colors), same results as blockColor without branches,
+    // division by 2 or 3 is a multiplication by the fixed-point reciprocal, exact for sums up to 3 * 255
+    static uint32_t const weight0[2][4] = { { 2, 0, 1, 0 }, { 3, 0, 2, 1 } };
+    static uint32_t const weight1[2][4] = { { 0, 2, 1, 0 }, { 0, 3, 1, 2 } };
+    static uint32_t const reciprocal[2] = { 32768, 21846 };
+
+    uint32_t c0 = block[0] & 0xffff;
+    uint32_t c1 = block[0] >> 16;
+    uint32_t index = (block[1] >> (2 * i)) & 3;
+    uint32_t fourColors = bc3 || c0 > c1;
+    uint32_t w0 = weight0[fourColors][index];
+    uint32_t w1 = weight1[fourColors][index];
+    uint32_t scale = reciprocal[fourColors];
+
+    glm::uvec3 e0 = glm::uvec3(expandColor565(c0));
+    glm::uvec3 e1 = glm::uvec3(expandColor565(c1));
+    glm::uvec3 color = ((e0 * w0 + e1 * w1) * scale) >> 16u;
+    return color.r | color.g << 8 | color.b << 16 | 0xff000000u;
+}
+
+/**
+ * Alpha of texel i of BC3 alpha block.
+ */
+inline uint32_t decodeAlphaBlock(uint32_t const* block, uint32_t i)
+{
+    uint64_t bits = block[0] | (uint64_t)block[1] << 32;
+    return blockAlpha(bits & 255, (bits >> 8) & 255, (bits >> (16 + 3 * i)) & 7);
+}
+
+/**
+ * Texels of 4x4 block (bx, by) of a row-major RGBA8 level, texels outside of the level repeat its edge.
+ */
+void loadBlock(uint32_t const* src, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, uint32_t texels[16])
+{
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        uint32_t x = glm::min(bx * 4 + (i & 3), width - 1);
+        uint32_t y = glm::min(by * 4 + (i >> 2), height - 1);
+        texels[i] = src[y * width + x];
+    }
+}
+
+inline glm::ivec3 texelColor(uint32_t texel)
+{
+    return glm::ivec3(texel & 255, (texel >> 8) & 255, (texel >> 16) & 255);
+}
+
+/**
+ * Encodes colors of 16 texels into BC1 color block in four-color mode.
+ * Endpoints are corners of the bounding box of the colors moved inwards by 1/16 of its size,
+ * the diagonal of the box follows the covariance of the channels with the channel of the largest range.
+ */
+void encodeColorBlock(uint32_t const texels[16], uint32_t* block)
+{
+    glm::ivec3 minColor = glm::ivec3(255);
+    glm::ivec3 maxColor = glm::ivec3(0);
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        minColor = glm::min(minColor, texelColor(texels[i]));
+        maxColor = glm::max(maxColor, texelColor(texels[i]));
+    }
+
+    // channels that decrease with the channel of the largest range are swapped on the diagonal
+    glm::ivec3 range = maxColor - minColor;
+    int reference = range.r >= range.g && range.r >= range.b ? 0 : range.g >= range.b ? 1 : 2;
+    glm::ivec3 center = (minColor + maxColor) / 2;
+    glm::ivec3 covariance = glm::ivec3(0);
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        glm::ivec3 d = texelColor(texels[i]) - center;
+        covariance += d * d[reference];
+    }
+    for (int c = 0; c < 3; ++c)
+        if (covariance[c] < 0)
+            std::swap(minColor[c], maxColor[c]);
+
+    glm::ivec3 inset = (maxColor - minColor) / 16;
+    uint32_t c0 = packColor565(glm::clamp(maxColor - inset, 0, 255));
+    uint32_t c1 = packColor565(glm::clamp(minColor + inset, 0, 255));
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        glm::ivec3 palette[4];
+        for (uint32_t p = 0; p < 4; ++p)
+            palette[p] = blockColor(c0, c1, p, true);
+
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            uint32_t best = 0;
+            int bestError = std::numeric_limits<int>::max();
+            for (uint32_t p = 0; p < 4; ++p)
+            {
+                glm::ivec3 d = texelColor(texels[i]) - palette[p];
+                int error = d.r * d.r + d.g * d.g + d.b * d.b;
+                if (error < bestError)
+                {
+                    best = p;
+                    bestError = error;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+
+    block[0] = c0 | c1 << 16;
+    block[1] = indices;
+}
+
+/**
+ * Encodes alphas of 16 texels into BC3 alpha block, endpoints are the largest and the smallest alpha.
+ */
+void encodeAlphaBlock(uint32_t const texels[16], uint32_t* block)
+{
+    uint32_t a0 = 0, a1 = 255;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        a0 = glm::max(a0, texels[i] >> 24);
+        a1 = glm::min(a1, texels[i] >> 24);
+    }
+
+    uint64_t bits = a0 | a1 << 8;
+    if (a0 != a1)
+    {
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            uint32_t best = 0;
+            uint32_t bestError = 256;
+            for (uint32_t p = 0; p < 8; ++p)
+            {
+                uint32_t error = (uint32_t)std::abs((int)blockAlpha(a0, a1, p) - (int)(texels[i] >> 24));
+                if (error < bestError)
+                {
+                    best = p;
+                    bestError = error;
+                }
+            }
+            bits |= (uint64_t)best << (16 + 3 * i);
+        }
+    }
+
+    block[0] = (uint32_t)bits;
+    block[1] = (uint32_t)(bits >> 32);
+}
+
+/**
+ * @brief This function encodes texture and its full mipmap chain into BC1 blocks, or into BC3 blocks if the texture is not opaque.
+ * Blocks take 8 (BC1) or 4 (BC3) times less memory than tiled RGBA8 texels and sample_texture decodes them on the fly.
+ * Mipmaps are box filtered level by level in a temporary RGBA8 copy, row-major mipmaps are not needed.
+ *
+ * @param texture texture, its nofLevels, texels, levelOffsets and format are set
+ *
+ * @return storage of the blocks
+ */
+std::vector<uint32_t> compress_texture(Texture& texture) {
+    texture.texels = nullptr;
+    if (!texture.data || !texture.width || !texture.height)
+        return {};
+
+    bool opaque = true;
+    for (size_t i = 3; texture.channels >= 4 && i < (size_t)texture.width * texture.height * texture.channels; i += texture.channels)
+        opaque &= texture.data[i] == 255;
+    texture.format = opaque ? TextureFormat::BC1 : TextureFormat::BC3;
+    uint32_t blockSize = opaque ? 2 : 4;
+
+    texture.nofLevels = fullMipmapLevels(texture.width, texture.height);
+    std::vector<uint32_t> storage(setBlockLevelOffsets(texture, blockSize));
+
+    std::vector<uint32_t> level((size_t)texture.width * texture.height);
+    for (size_t i = 0; i < level.size(); ++i)
+        level[i] = packTexel(texture.data + i * texture.channels, texture.channels);
+
+    std::vector<uint32_t> nextLevel;
+    uint32_t width = texture.width;
+    uint32_t height = texture.height;
+    for (uint32_t l = 0; l < texture.nofLevels; ++l)
+    {
+        uint32_t* dst = storage.data() + texture.levelOffsets[l];
+        uint32_t texels[16];
+        for (uint32_t by = 0; by < (height + 3) >> 2; ++by)
+            for (uint32_t bx = 0; bx < (width + 3) >> 2; ++bx, dst += blockSize)
+            {
+                loadBlock(level.data(), width, height, bx, by, texels);
+                if (opaque)
+                {
+                    encodeColorBlock(texels, dst);
+                    continue;
+                }
+                encodeAlphaBlock(texels, dst);
+                encodeColorBlock(texels, dst + 2);
+            }
+
+        if (l + 1 == texture.nofLevels)
+            break;
+
+        // the next level averages 2x2 texels, same as generate_mipmaps and tile_texture
+        uint32_t nextWidth = glm::max(width >> 1, 1u);
+        uint32_t nextHeight = glm::max(height >> 1, 1u);
+        nextLevel.resize((size_t)nextWidth * nextHeight);
+        for (uint32_t y = 0; y < nextHeight; ++y)
+        {
+            uint32_t y0 = glm::min(2 * y, height - 1) * width;
+            uint32_t y1 = glm::min(2 * y + 1, height - 1) * width;
+            for (uint32_t x = 0; x < nextWidth; ++x)
+            {
+                uint32_t x0 = glm::min(2 * x, width - 1);
+                uint32_t x1 = glm::min(2 * x + 1, width - 1);
+                nextLevel[y * nextWidth + x] = averageTexels(level[y0 + x0], level[y0 + x1], level[y1 + x0], level[y1 + x1]);
+            }
+        }
+        level.swap(nextLevel);
+        width = nextWidth;
+        height = nextHeight;
+    }
+
+    texture.texels = storage.data();
+    return storage;
+}
+
+/**
+ * RGBA8 texel (x, y) of a level stored in 4x4 blocks of the format.
+ */
+template<TextureFormat FORMAT>
+inline uint32_t fetchTexel(uint32_t const* texels, uint32_t x, uint32_t y, uint32_t tilesX)
+{
+    uint32_t block = (y >> 2) * tilesX + (x >> 2);
+    uint32_t i = ((y & 3) << 2) | (x & 3);
+    switch (FORMAT)
+    {
+    case TextureFormat::RGBA8:
+        return texels[tiledTexelIndex(x, y, tilesX)];
+    case TextureFormat::BC1:
+        return decodeColorBlock(texels + block * 2, i, false);
+    default:
+        return (decodeColorBlock(texels + block * 4 + 2, i, true) & 0xffffff) | decodeAlphaBlock(texels + block * 4, i) << 24;
+    }
+}
+
+/**
+ * Maps texture coordinate to the range where wrapTexel expects texels, precision of large coordinates is kept.
+ */
+template<TextureWrap WRAP>
+float wrapCoordinate(float u)
+{
+    switch (WRAP)
+    {
+    case TextureWrap::REPEAT:
+        return u - std::floor(u);
+    case TextureWrap::CLAMP_TO_EDGE:
+        return glm::clamp(u, -1.f, 2.f);
+    default:
+        return u - 2.f * std::floor(u * 0.5f);
+    }
+}
+
+/**
+ * Wraps texel coordinate x into [0, size), sizes that are power of two are wrapped by masks.
+ */
+template<TextureWrap WRAP, bool POW2>
+int wrapTexel(int x, int size)
+{
+    switch (WRAP)
+    {
+    case TextureWrap::REPEAT:
+        if (POW2)
+            return x & (size - 1);
+        x %= size;
+        return x < 0 ? x + size : x;
+    case TextureWrap::CLAMP_TO_EDGE:
+        return std::min(std::max(x, 0), size - 1);
+    default:
+        if (POW2)
+        {
+            x &= 2 * size - 1;
+            return x & size ? ~x & (size - 1) : x;
+        }
+        x %= 2 * size;
+        if (x < 0)
+            x += 2 * size;
+        return x < size ? x : 2 * size - 1 - x;
+    }
+}
+
+/**
+ * Colors of 4 RGBA8 texels, every texel is unpacked into 4 floats in [0, 255].
+ */
+inline void unpackTexels(__m128i texels, __m128 colors[4])
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(texels, zero);
+    __m128i hi = _mm_unpackhi_epi8(texels, zero);
+    colors[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+    colors[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+    colors[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+    colors[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+}
+
+/**
+ * Sampler of one level of texels specialized for format, filtering, wrapping of both axes and power of two sizes.
+ */
+using TextureSampler = glm::vec4 (*)(Texture const& texture, uint32_t level, glm::vec2 uv);
+
+template<TextureFormat FORMAT, TextureFilter FILTER, TextureWrap WRAP_S, TextureWrap WRAP_T, bool POW2>
+glm::vec4 sampleLevel(Texture const& texture, uint32_t level, glm::vec2 uv)
+{
+    int width = (int)glm::max(texture.width >> level, 1u);
+    int height = (int)glm::max(texture.height >> level, 1u);
+    uint32_t tilesX = (uint32_t)(width + 3) >> 2;
+    uint32_t const* texels = texture.texels + texture.levelOffsets[level];
+
+    float s = wrapCoordinate<WRAP_S>(uv.x) * width;
+    float t = wrapCoordinate<WRAP_T>(uv.y) * height;
+
+    __m128 colors[4];
+    __m128 color;
+    if (FILTER == TextureFilter::NEAREST)
+    {
+        int x = wrapTexel<WRAP_S, POW2>((int)std::floor(s), width);
+        int y = wrapTexel<WRAP_T, POW2>((int)std::floor(t), height);
+        unpackTexels(_mm_cvtsi32_si128((int)fetchTexel<FORMAT>(texels, x, y, tilesX)), colors);
+        color = colors[0];
+    }
+    else
+    {
+        // texel centers are at half-integer coordinates
+        s -= 0.5f;
+        t -= 0.5f;
+        float s0 = std::floor(s);
+        float t0 = std::floor(t);
+        int x0 = wrapTexel<WRAP_S, POW2>((int)s0, width);
+        int x1 = wrapTexel<WRAP_S, POW2>((int)s0 + 1, width);
+        int y0 = wrapTexel<WRAP_T, POW2>((int)t0, height);
+        int y1 = wrapTexel<WRAP_T, POW2>((int)t0 + 1, height);
+
+        unpackTexels(_mm_setr_epi32(
+            (int)fetchTexel<FORMAT>(texels, x0, y0, tilesX), (int)fetchTexel<FORMAT>(texels, x1, y0, tilesX),
+            (int)fetchTexel<FORMAT>(texels, x0, y1, tilesX), (int)fetchTexel<FORMAT>(texels, x1, y1, tilesX)), colors);
+
+        __m128 fs = _mm_set1_ps(s - s0);
+        __m128 ft = _mm_set1_ps(t - t0);
+        __m128 top = _mm_add_ps(colors[0], _mm_mul_ps(_mm_sub_ps(colors[1], colors[0]), fs));
+        __m128 bottom = _mm_add_ps(colors[2], _mm_mul_ps(_mm_sub_ps(colors[3], colors[2]), fs));
+        color = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), ft));
+    }
+
+    glm::vec4 result;
+    _mm_storeu_ps(&result[0], _mm_mul_ps(color, _mm_set1_ps(1.f / 255.f)));
+    return result;
+}
+
+template<TextureFormat FORMAT, TextureFilter FILTER, TextureWrap WRAP_S>
+TextureSampler textureSampler(TextureWrap wrapT, bool pow2)
+{
+    switch (wrapT)
+    {
+    case TextureWrap::REPEAT:
+        return pow2 ? sampleLevel<FORMAT, FILTER, WRAP_S, TextureWrap::REPEAT, true> : sampleLevel<FORMAT, FILTER, WRAP_S, TextureWrap::REPEAT, false>;
+    case TextureWrap::CLAMP_TO_EDGE:
+        return pow2 ? sampleLevel<FORMAT, FILTER, WRAP_S, TextureWrap::CLAMP_TO_EDGE, true> : sampleLevel<FORMAT, FILTER, WRAP_S, TextureWrap::CLAMP_TO_EDGE, false>;
+    default:
+        return pow2 ? sampleLevel<FORMAT, FILTER, WRAP_S, TextureWrap::MIRRORED_REPEAT, true> : sampleLevel<FORMAT, FILTER, WRAP_S, TextureWrap::MIRRORED_REPEAT, false>;
+    }
+}
+
+template<TextureFormat FORMAT, TextureFilter FILTER>
+TextureSampler textureSampler(TextureWrap wrapS, TextureWrap wrapT, bool pow2)
+{
+    switch (wrapS)
+    {
+    case TextureWrap::REPEAT:
+        return textureSampler<FORMAT, FILTER, TextureWrap::REPEAT>(wrapT, pow2);
+    case TextureWrap::CLAMP_TO_EDGE:
+        return textureSampler<FORMAT, FILTER, TextureWrap::CLAMP_TO_EDGE>(wrapT, pow2);
+    default:
+        return textureSampler<FORMAT, FILTER, TextureWrap::MIRRORED_REPEAT>(wrapT, pow2);
+    }
+}
+
+template<TextureFormat FORMAT>
+TextureSampler textureSampler(TextureFilter filter, TextureWrap wrapS, TextureWrap wrapT, bool pow2)
+{
+    if (filter == TextureFilter::NEAREST)
+        return textureSampler<FORMAT, TextureFilter::NEAREST>(wrapS, wrapT, pow2);
+    return textureSampler<FORMAT, TextureFilter::LINEAR>(wrapS, wrapT, pow2);
+}
+
+/**
+ * Picks the sampler instance matching format, filter, wrap modes and size of the texture.
+ */
+TextureSampler selectTextureSampler(Texture const& texture, TextureFilter filter, TextureWrap wrapS, TextureWrap wrapT)
+{
+    bool pow2 = !(texture.width & (texture.width - 1)) && !(texture.height & (texture.height - 1));
+    switch (texture.format)
+    {
+    case TextureFormat::RGBA8: return textureSampler<TextureFormat::RGBA8>(filter, wrapS, wrapT, pow2);
+    case TextureFormat::BC1:   return textureSampler<TextureFormat::BC1>(filter, wrapS, wrapT, pow2);
+    default:                   return textureSampler<TextureFormat::BC3>(filter, wrapS, wrapT, pow2);
+    }
+}
+
+/**
+ * Nearest texel of a level of texels with repeat wrapping, read_texture reads textures without row-major data by it.
+ */
+glm::vec4 readTexels(Texture const& texture, uint32_t level, glm::vec2 uv)
+{
+    return selectTextureSampler(texture, TextureFilter::NEAREST, TextureWrap::REPEAT, TextureWrap::REPEAT)(texture, level, uv);
+}
+
+/**
+ * @brief This function samples tiled or compressed texture with its filters and wrap modes at the mipmap level chosen by derivatives.
+ * Textures without texels are read by read_texture.
+ *
+ * @param texture texture
+ * @param uv uv coordinates
+ * @param dUVdx derivative of uv in screen space x
+ * @param dUVdy derivative of uv in screen space y
+ *
+ * @return color 4 floats
+ */
+glm::vec4 sample_texture(Texture const& texture, glm::vec2 uv, glm::vec2 dUVdx, glm::vec2 dUVdy) {
+    if (!texture.texels)
+        return read_texture(texture, uv, dUVdx, dUVdy);
+
+    float footprint = textureFootprint(texture, dUVdx, dUVdy);
+    // pixel larger than a texel is minified, the filter applies within the chosen level
+    TextureFilter filter = footprint > 1.f ? texture.minFilter : texture.magFilter;
+    return selectTextureSampler(texture, filter, texture.wrapS, texture.wrapT)(texture, textureLevel(texture, footprint), uv);
 }
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <student/fwd.hpp>
+#include <future>
 
 /**
  * @brief function that executes work stored in command buffer on the gpu memory.
@@ -19,4 +20,86 @@
  */
 void gpu_execute(GPUMemory&mem,CommandBuffer&cb);
 
+/**
+ * @brief This type represents fence of work submitted by gpu_execute_async.
+ * wait() blocks until the command buffer is executed.
+ */
+using GPUFence = std::shared_future<void>;
+
+/**
+ * @brief function that submits work stored in command buffer to the gpu and returns immediately.
+ * Submitted command buffers are executed in submission order on a gpu thread.
+ * mem and cb must stay unchanged until the fence is signaled,
+ * so the next frame is usually recorded into another command buffer and GPUMemory.
+ * The fences have to be waited for before gpu_execute is called again from other threads.
+ *
+ * @param mem gpu memory
+ * @param cb command buffer - packaged of work sent to the gpu
+ *
+ * @return fence signaled when the work is finished
+ */
+GPUFence gpu_execute_async(GPUMemory&mem,CommandBuffer&cb);
+
 glm::vec4 read_texture(Texture const&texture,glm::vec2 uv);
+
+/**
+ * @brief function that reads color from mipmap level of texture chosen by screen space derivatives of uv.
+ * Without derivatives (zero) or mipmaps it reads the same color as read_texture(texture,uv).
+ * Texture without row-major data (Texture::data is nullptr) is read from its texels without filtering with repeat wrapping.
+ *
+ * @param texture texture
+ * @param uv uv coordinates
+ * @param dUVdx derivative of uv in screen space x, see InFragment::dFdx
+ * @param dUVdy derivative of uv in screen space y, see InFragment::dFdy
+ *
+ * @return color 4 floats
+ */
+glm::vec4 read_texture(Texture const&texture,glm::vec2 uv,glm::vec2 dUVdx,glm::vec2 dUVdy);
+
+/**
+ * @brief function that generates mipmap levels of texture by averaging 2x2 texels of the previous level.
+ * All levels including a copy of the base level are stored one after another in the returned storage,
+ * Texture::data points to it, so the storage has to live as long as the texture is used.
+ *
+ * @param texture texture, its data and nofLevels are set
+ *
+ * @return storage of all levels
+ */
+std::vector<uint8_t> generate_mipmaps(Texture&texture);
+
+/**
+ * @brief function that copies texture into RGBA8 texels stored in 4x4 tiles and builds their mipmaps for sample_texture.
+ * Texture points into the returned storage, so the storage has to live as long as the texture is used.
+ * Texture::data is not read by sample_texture afterwards, so it can be released and set to nullptr.
+ *
+ * @param texture texture, its nofLevels, texels, levelOffsets and format are set
+ *
+ * @return storage of the tiled texels
+ */
+std::vector<uint32_t> tile_texture(Texture&texture);
+
+/**
+ * @brief function that encodes texture and its mipmaps into BC1 blocks (BC3 blocks if the texture has alpha) for sample_texture.
+ * Texture points into the returned storage, so the storage has to live as long as the texture is used.
+ * Texture::data is not read by sample_texture afterwards, so it can be released and set to nullptr.
+ *
+ * @param texture texture, its nofLevels, texels, levelOffsets and format are set
+ *
+ * @return storage of the blocks
+ */
+std::vector<uint32_t> compress_texture(Texture&texture);
+
+/**
+ * @brief function that samples texture with its Texture::magFilter or Texture::minFilter and Texture::wrapS and Texture::wrapT.
+ * Texel centers are at ((i+0.5)/width, (j+0.5)/height), the level is chosen by derivatives of uv,
+ * minFilter is used when a pixel covers more than one texel of the base level.
+ * Textures without texels (see tile_texture and compress_texture) are read by read_texture(texture,uv,dUVdx,dUVdy).
+ *
+ * @param texture texture
+ * @param uv uv coordinates
+ * @param dUVdx derivative of uv in screen space x
+ * @param dUVdy derivative of uv in screen space y
+ *
+ * @return color 4 floats
+ */
+glm::vec4 sample_texture(Texture const&texture,glm::vec2 uv,glm::vec2 dUVdx,glm::vec2 dUVdy);
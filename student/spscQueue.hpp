@@ -0,0 +1,82 @@
+/*!
+ * @file
+ * @brief This file contains bounded lock-free queue connecting stages of the pipelined gpu.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+/**
+ * @brief This class represents bounded lock-free queue of one producer and one consumer thread.
+ * Items are written and read in place, so large items (triangles) are not copied through temporaries.
+ * Waiting threads yield, the numbers of waits tell which side of the queue is the bottleneck.
+ */
+template<typename T, uint32_t CAPACITY>
+class SpscQueue
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity has to be power of two");
+
+public:
+    /**
+     * @brief This function returns slot of the next item, it waits while the queue is full.
+     * The item becomes visible to the consumer by push().
+     */
+    T& back()
+    {
+        uint32_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - head.load(std::memory_order_acquire) == CAPACITY)
+        {
+            nofFullWaits++;
+            while (tail - head.load(std::memory_order_acquire) == CAPACITY)
+                std::this_thread::yield();
+        }
+        return items[tail & (CAPACITY - 1)];
+    }
+
+    void push()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief This function returns the oldest item, it waits while the queue is empty.
+     * The slot is returned to the producer by pop().
+     */
+    T& front()
+    {
+        uint32_t head = this->head.load(std::memory_order_relaxed);
+        if (tail.load(std::memory_order_acquire) == head)
+        {
+            nofEmptyWaits++;
+            while (tail.load(std::memory_order_acquire) == head)
+                std::this_thread::yield();
+        }
+        return items[head & (CAPACITY - 1)];
+    }
+
+    void pop()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief This function returns how many times the producer found the queue full.
+     */
+    uint64_t getNofFullWaits() const { return nofFullWaits; }
+
+    /**
+     * @brief This function returns how many times the consumer found the queue empty.
+     */
+    uint64_t getNofEmptyWaits() const { return nofEmptyWaits; }
+
+private:
+    T items[CAPACITY];
+
+    // producer side and consumer side are on separate cache lines
+    alignas(64) std::atomic<uint32_t> tail{ 0 };
+    uint64_t                          nofFullWaits = 0;
+    alignas(64) std::atomic<uint32_t> head{ 0 };
+    uint64_t                          nofEmptyWaits = 0;
+};
@@ -0,0 +1,102 @@
+/*!
+ * @file
+ * @brief This file contains implementation of pool of worker threads.
+ */
+
+#include <student/threadPool.hpp>
+#include <algorithm>
+#include <map>
+#include <memory>
+
+ThreadPool::ThreadPool(uint32_t nofThreads)
+{
+    for (uint32_t i = 1; i < nofThreads; ++i)
+        workers.emplace_back([this, i]() { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wakeUp.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+uint32_t ThreadPool::getNofThreads() const
+{
+    return (uint32_t)workers.size() + 1;
+}
+
+void ThreadPool::runJobs(uint32_t thread)
+{
+    for (uint32_t i = nextJob++; i < nofJobs; i = nextJob++)
+        (*job)(i, thread);
+}
+
+void ThreadPool::parallelFor(uint32_t jobs, Job const& fce)
+{
+    if (workers.empty() || jobs <= 1)
+    {
+        for (uint32_t i = 0; i < jobs; ++i)
+            fce(i, 0);
+        return;
+    }
+
+    std::lock_guard<std::mutex> dispatchLock(dispatch);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job        = &fce;
+        nofJobs    = jobs;
+        nextJob    = 0;
+        nofRunning = (uint32_t)workers.size();
+        generation++;
+    }
+    wakeUp.notify_all();
+
+    runJobs(0);
+
+    // wait for workers, they may still be finishing their last job
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return nofRunning == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::workerLoop(uint32_t thread)
+{
+    uint64_t lastGeneration = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [&]() { return stop || generation != lastGeneration; });
+            if (stop) return;
+            lastGeneration = generation;
+        }
+
+        runJobs(thread);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--nofRunning == 0)
+            finished.notify_one();
+    }
+}
+
+ThreadPool& getThreadPool(uint32_t nofThreads)
+{
+    static std::mutex mutex;
+    static std::map<uint32_t, std::unique_ptr<ThreadPool>> pools;
+
+    if (nofThreads == 0)
+        nofThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& pool = pools[nofThreads];
+    if (!pool)
+        pool = std::make_unique<ThreadPool>(nofThreads);
+
+    return *pool;
+}
@@ -0,0 +1,68 @@
+/*!
+ * @file
+ * @brief This file contains pool of worker threads used by the gpu.
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief This class represents pool of persistent worker threads.
+ * Jobs of one parallelFor are distributed dynamically, the calling thread works too.
+ */
+class ThreadPool
+{
+public:
+    using Job = std::function<void(uint32_t job, uint32_t thread)>;
+
+    explicit ThreadPool(uint32_t nofThreads);
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    /**
+     * @brief This function returns number of threads including the calling thread.
+     */
+    uint32_t getNofThreads() const;
+
+    /**
+     * @brief This function runs fce(job, thread) for every job in [0, nofJobs) and waits for all of them.
+     * Calls from different threads are serialized, jobs must not call parallelFor of the same pool.
+     *
+     * @param nofJobs number of jobs
+     * @param fce job function, thread is in [0, getNofThreads())
+     */
+    void parallelFor(uint32_t nofJobs, Job const& fce);
+
+private:
+    void workerLoop(uint32_t thread);
+    void runJobs(uint32_t thread);
+
+    std::vector<std::thread> workers;
+    std::mutex               dispatch;  // held by the thread whose jobs run
+    std::mutex               mutex;
+    std::condition_variable  wakeUp;
+    std::condition_variable  finished;
+    Job const*               job        = nullptr;
+    uint32_t                 nofJobs    = 0;
+    std::atomic<uint32_t>    nextJob    {0};
+    uint32_t                 nofRunning = 0;
+    uint64_t                 generation = 0;
+    bool                     stop       = false;
+};
+
+/**
+ * @brief This function returns shared thread pool of the gpu.
+ * There is one pool per number of threads, pools live until the end of the program,
+ * so threads with different settings do not destroy pools used by each other.
+ *
+ * @param nofThreads requested number of threads (0 - one per hardware thread)
+ */
+ThreadPool& getThreadPool(uint32_t nofThreads);
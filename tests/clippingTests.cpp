@@ -169,3 +169,106 @@ SCENARIO("24"){
     REQUIRE(inFragments.size() >= expectedCount - err);
 }
 
+
+SCENARIO("47"){
+  std::cerr << "47 - clipping - triangle with vertices far outside of the screen" << std::endl;
+
+  auto&inFragments = dumpInject.inFragments;
+  auto&outVertices = dumpInject.outVertices;
+
+  outVertices.clear();
+  inFragments.clear();
+  // covers the whole screen, clipped by the guard band into a fan of triangles
+  outVertices.push_back({{},glm::vec4(-1.f,-1.f,0.f,1.f)});
+  outVertices.push_back({{},glm::vec4(+1e7f,-1.f,0.f,1.f)});
+  outVertices.push_back({{},glm::vec4(-1.f,+1e7f,0.f,1.f)});
+  // whole triangle is right of the screen
+  outVertices.push_back({{},glm::vec4(+2.f,-1.f,0.f,1.f)});
+  outVertices.push_back({{},glm::vec4(+1e7f,-1.f,0.f,1.f)});
+  outVertices.push_back({{},glm::vec4(+2.f,+1e7f,0.f,1.f)});
+
+  uint32_t w = 100;
+  uint32_t h = 100;
+
+  auto framebuffer = std::make_shared<Framebuffer>(w,h);
+
+  MEMCB();
+
+  mem.framebuffer = framebuffer->getFrame();
+  mem.programs[0].vertexShader = vertexShaderInject;
+  mem.programs[0].fragmentShader = fragmentShaderDump;
+
+  pushDrawCommand(cb,(uint32_t)outVertices.size());
+
+  gpu_execute(mem,cb);
+
+  std::vector<uint32_t>counts(w*h,0);
+  for(auto const&f:inFragments)
+    counts.at((uint32_t)f.gl_FragCoord.x+(uint32_t)f.gl_FragCoord.y*w)++;
+
+  bool success = inFragments.size() == w*h;
+  for(auto const&c:counts)success &= c == 1;
+
+  if(!success){
+    std::cerr << R".(
+    Trojúhelník s vrcholy daleko mimo obrazovku pokrývá celou obrazovku.
+    Každý pixel musí být vyrasterizován právě jednou.
+    počet vyrasterizovaných fragmentů: )."<<inFragments.size()<<R".(
+    očekávaný počet fragmentů: )."<<w*h<<std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("50"){
+  std::cerr << "50 - clipping - backface culling in clip space before clipping" << std::endl;
+
+  auto&inFragments = dumpInject.inFragments;
+  auto&outVertices = dumpInject.outVertices;
+
+  // clockwise triangles, the second one crosses the near plane
+  std::vector<OutVertex>cw = {
+    {{},glm::vec4(-1.f,-1.f,0.f,1.f)},{{},glm::vec4(-1.f,+1.f,0.f,1.f)},{{},glm::vec4(+1.f,-1.f,0.f,1.f)},
+    {{},glm::vec4(-0.5f,-0.5f,0.5f,1.f)},{{},glm::vec4(-0.5f,+0.5f,0.5f,1.f)},{{},glm::vec4(+2.f,-0.5f,-3.f,-2.f)},
+  };
+
+  uint32_t w = 100;
+  uint32_t h = 100;
+
+  auto render = [&](bool counterClockwiseToo,bool backfaceCulling){
+    outVertices = cw;
+    if(counterClockwiseToo)
+      for(size_t i=0;i<cw.size();i+=3){
+        outVertices.push_back(cw[i+0]);
+        outVertices.push_back(cw[i+2]);
+        outVertices.push_back(cw[i+1]);
+      }
+    inFragments.clear();
+
+    auto framebuffer = std::make_shared<Framebuffer>(w,h);
+
+    MEMCB();
+
+    mem.framebuffer = framebuffer->getFrame();
+    mem.programs[0].vertexShader = vertexShaderInject;
+    mem.programs[0].fragmentShader = fragmentShaderDump;
+
+    pushDrawCommand(cb,(uint32_t)outVertices.size(),0,{},backfaceCulling);
+    cb.commands[0].data.drawCommand.frontFace = FrontFace::CW;
+
+    gpu_execute(mem,cb);
+    return inFragments.size();
+  };
+
+  auto expected = render(false,false);
+  auto culled   = render(true ,true );
+
+  if(expected == 0 || culled != expected){
+    std::cerr << R".(
+    S DrawCommand::frontFace == FrontFace::CW jsou předními stěnami trojúhelníky po směru hodinových ručiček.
+    Se zapnutým backfaceCulling se mají ostatní trojúhelníky zahodit,
+    i když protínají near rovinu (jejich orientace se pozná už v clip space).
+    počet fragmentů trojúhelníků po směru hodinových ručiček: )."<<expected<<R".(
+    počet fragmentů s backface cullingem: )."<<culled<<std::endl;
+    REQUIRE(false);
+  }
+}
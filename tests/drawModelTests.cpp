@@ -5,6 +5,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <tests/modelTestUtils.hpp>
+#include <framework/model.hpp>
+#include <student/gpu.hpp>
 
 using namespace tests;
 using namespace tests::model;
@@ -114,3 +116,74 @@ SCENARIO("39"){
   checkModelMemory(model,Diff::INV_MATRIX);
 }
 
+
+SCENARIO("61"){
+  std::cerr << "61 - loaded model textures keep only tiled texels or compressed blocks" << std::endl;
+
+  bool success = true;
+  for(bool compressTextures:{false,true}){
+    ModelData modelData;
+    modelData.load(std::string(CMAKE_ROOT_DIR)+"/resources/models/glorious_duck/scene.gltf",compressTextures);
+    auto model = modelData.getModel();
+
+    success &= !model.textures.empty();
+    for(auto const&t:model.textures){
+      success &= t.data   == nullptr;
+      success &= t.texels != nullptr;
+      success &= compressTextures ? t.format != TextureFormat::RGBA8 : t.format == TextureFormat::RGBA8;
+      success &= t.nofLevels > 1 && (t.width>>(t.nofLevels-1) <= 1) && (t.height>>(t.nofLevels-1) <= 1);
+      // sampler of the model is LINEAR/LINEAR_MIPMAP_LINEAR without wrap modes
+      success &= t.magFilter == TextureFilter::LINEAR && t.minFilter == TextureFilter::LINEAR;
+      success &= t.wrapS == TextureWrap::REPEAT && t.wrapT == TextureWrap::REPEAT;
+    }
+  }
+
+  if(!success){
+    std::cerr << R".(
+    Textury načteného modelu jsou při načtení přeskládány do dlaždic (Texture::texels) včetně mipmap,
+    s --compressed-textures jsou zakódovány do bloků BC1/BC3.
+    Dekódovaný obrázek se uvolní a mipmapy po řádcích se nevytváří, Texture::data je nullptr.
+    ).";
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("62"){
+  std::cerr << "62 - read_texture reads loaded model textures from their texels" << std::endl;
+
+  bool success = true;
+  std::string wrong;
+  for(bool compressTextures:{false,true}){
+    ModelData modelData;
+    modelData.load(std::string(CMAKE_ROOT_DIR)+"/resources/models/glorious_duck/scene.gltf",compressTextures);
+    auto model = modelData.getModel();
+
+    for(auto const&t:model.textures){
+      Texture nearest = t;
+      nearest.magFilter = TextureFilter::NEAREST;
+      nearest.wrapS     = TextureWrap::REPEAT;
+      nearest.wrapT     = TextureWrap::REPEAT;
+
+      bool notBlack = false;
+      for(auto uv:{glm::vec2(.1f,.2f),glm::vec2(.5f,.5f),glm::vec2(.73f,.31f),glm::vec2(-.4f,1.6f),glm::vec2(2.25f,-3.9f)}){
+        auto color    = read_texture(t,uv);
+        auto expected = sample_texture(nearest,uv,glm::vec2(0.f),glm::vec2(0.f));
+        notBlack |= color != glm::vec4(0.f);
+        if(color != expected || read_texture(t,uv,glm::vec2(0.f),glm::vec2(0.f)) != expected){
+          success = false;
+          wrong = "komprese: "+str(compressTextures)+" uv: "+str(uv)+"\n    barva: "+str(color)+"\n    očekávaná barva: "+str(expected);
+        }
+      }
+      success &= notBlack;
+    }
+  }
+
+  if(!success){
+    std::cerr << R".(
+    Textury načteného modelu nemají Texture::data, read_texture proto čte základní úroveň Texture::texels
+    bez filtrování (NEAREST) s opakováním (REPEAT), stejně jako sample_texture s nulovými derivacemi.
+
+    )." << wrong << std::endl;
+    REQUIRE(false);
+  }
+}
@@ -0,0 +1,495 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <set>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <student/gpu.hpp>
+#include <framework/bunny.hpp>
+#include <framework/framebuffer.hpp>
+#include <tests/testCommon.hpp>
+
+using namespace tests;
+
+namespace executionTests{
+
+std::atomic<uint32_t>nofBunnyInvocations;
+std::atomic<uint32_t>nofBunnyFragments;
+
+void bunnyVertexShader(OutVertex&outVertex,InVertex const&inVertex,ShaderInterface const&si){
+  nofBunnyInvocations++;
+  auto pos = glm::vec4(inVertex.attributes[0].v3,1.f);
+  pos.x += 0.4f*(float)inVertex.gl_DrawID - 0.2f;
+  outVertex.gl_Position      = si.uniforms[0].m4 * pos;
+  outVertex.attributes[0].v3 = glm::vec3(pos);
+  outVertex.attributes[1].v3 = inVertex.attributes[1].v3;
+}
+
+void bunnyVertexPacketShader(OutVertexPacket&outPacket,InVertexPacket const&inPacket,ShaderInterface const&si){
+  for(uint32_t i=0;i<inPacket.nofVertices;++i){
+    InVertex inVertex;
+    inVertex.gl_VertexID = inPacket.gl_VertexID[i];
+    inVertex.gl_DrawID   = inPacket.gl_DrawID;
+    for(uint32_t a=0;a<2;++a)
+      for(uint32_t c=0;c<3;++c)
+        inVertex.attributes[a].v3[c] = inPacket.attributes[a].v[c][i];
+    OutVertex outVertex;
+    bunnyVertexShader(outVertex,inVertex,si);
+    for(uint32_t a=0;a<2;++a)
+      for(uint32_t c=0;c<3;++c)
+        outPacket.attributes[a].v[c][i] = outVertex.attributes[a].v3[c];
+    for(uint32_t c=0;c<4;++c)
+      outPacket.gl_Position[c][i] = outVertex.gl_Position[c];
+  }
+}
+
+void bunnyFragmentShader(OutFragment&outFragment,InFragment const&inFragment,ShaderInterface const&si){
+  nofBunnyFragments++;
+  auto n = glm::normalize(inFragment.attributes[1].v3);
+  auto l = glm::normalize(si.uniforms[1].v3-inFragment.attributes[0].v3);
+  outFragment.gl_FragColor = glm::vec4(glm::vec3(.2f)+glm::vec3(.3f,.8f,.4f)*glm::max(glm::dot(n,l),0.f),1.f);
+}
+
+void bunnyFragmentPacketShader(OutFragmentPacket&outPacket,InFragmentPacket const&inPacket,ShaderInterface const&si){
+  for(uint32_t i=0;i<fragmentPacketSize;++i){
+    if(!(inPacket.coverage&(1u<<i)))continue;
+    InFragment inFragment;
+    for(uint32_t a=0;a<2;++a)
+      for(uint32_t c=0;c<3;++c)
+        inFragment.attributes[a].v3[c] = inPacket.attributes[a].v[c][i];
+    for(uint32_t c=0;c<4;++c)
+      inFragment.gl_FragCoord[c] = inPacket.gl_FragCoord[c][i];
+    OutFragment outFragment;
+    bunnyFragmentShader(outFragment,inFragment,si);
+    for(uint32_t c=0;c<4;++c)
+      outPacket.gl_FragColor[c][i] = outFragment.gl_FragColor[c];
+  }
+}
+
+glm::vec4 const overlayPositions[] = {
+  // translucent triangle over the whole frame
+  glm::vec4(-2.0f,-1.5f,+0.2f,1.f),glm::vec4(+2.5f,-0.5f,+0.1f,1.f),glm::vec4(-0.5f,+2.5f,+0.3f,1.f),
+  // triangle crossing the near plane
+  glm::vec4(-0.5f,-0.5f,-2.0f,1.f),glm::vec4(+0.9f,-0.2f,+0.5f,1.f),glm::vec4(-0.1f,+0.8f,+0.5f,1.f),
+};
+
+void overlayVertexShader(OutVertex&outVertex,InVertex const&inVertex,ShaderInterface const&){
+  outVertex.gl_Position      = overlayPositions[inVertex.gl_VertexID];
+  outVertex.attributes[0].v4 = glm::vec4(inVertex.gl_VertexID%3==0,inVertex.gl_VertexID%3==1,inVertex.gl_VertexID%3==2,.4f);
+}
+
+void overlayFragmentShader(OutFragment&outFragment,InFragment const&inFragment,ShaderInterface const&){
+  outFragment.gl_FragColor = inFragment.attributes[0].v4;
+}
+
+std::shared_ptr<Framebuffer>renderScene(GPUSettings const&settings,uint32_t width,uint32_t height,GPUStatistics*statistics = nullptr,bool earlyDepthTest = false,bool packetShader = false,bool vertexPacketShader = false,bool async = false){
+  MEMCB();
+
+  auto framebuffer = std::make_shared<Framebuffer>(width,height);
+  mem.framebuffer = framebuffer->getFrame();
+  mem.settings    = settings;
+
+  mem.buffers[0].data = bunnyVertices;
+  mem.buffers[0].size = sizeof(bunnyVertices);
+  mem.buffers[1].data = bunnyIndices;
+  mem.buffers[1].size = sizeof(bunnyIndices);
+
+  mem.programs[0].vertexShader   = bunnyVertexShader;
+  mem.programs[0].fragmentShader = bunnyFragmentShader;
+  mem.programs[0].vs2fs[0]       = AttributeType::VEC3;
+  mem.programs[0].vs2fs[1]       = AttributeType::VEC3;
+  mem.programs[0].earlyDepthTest = earlyDepthTest;
+  if(packetShader)mem.programs[0].fragmentPacketShader = bunnyFragmentPacketShader;
+  if(vertexPacketShader)mem.programs[0].vertexPacketShader = bunnyVertexPacketShader;
+
+  mem.programs[1].vertexShader   = overlayVertexShader;
+  mem.programs[1].fragmentShader = overlayFragmentShader;
+  mem.programs[1].vs2fs[0]       = AttributeType::VEC4;
+  mem.programs[1].earlyDepthTest = earlyDepthTest;
+
+  auto proj = glm::perspective(glm::radians(45.f),(float)width/(float)height,0.1f,10.f);
+  auto view = glm::lookAt(glm::vec3(0.5f,0.7f,2.8f),glm::vec3(0.f),glm::vec3(0.f,1.f,0.f));
+  mem.uniforms[0].m4 = proj*view;
+  mem.uniforms[1].v3 = glm::vec3(2.f,3.f,4.f);
+
+  VertexArray vao;
+  vao.vertexAttrib[0].bufferID = 0;
+  vao.vertexAttrib[0].type     = AttributeType::VEC3;
+  vao.vertexAttrib[0].stride   = sizeof(BunnyVertex);
+  vao.vertexAttrib[0].offset   = 0;
+  vao.vertexAttrib[1].bufferID = 0;
+  vao.vertexAttrib[1].type     = AttributeType::VEC3;
+  vao.vertexAttrib[1].stride   = sizeof(BunnyVertex);
+  vao.vertexAttrib[1].offset   = sizeof(glm::vec3);
+  vao.indexBufferID            = 1;
+  vao.indexType                = IndexType::UINT32;
+
+  uint32_t const nofIndices = sizeof(bunnyIndices)/sizeof(VertexIndex);
+
+  pushClearCommand(cb,glm::vec4(.1f,.2f,.3f,1.f));
+  pushDrawCommand (cb,nofIndices,0,vao,true );
+  pushDrawCommand (cb,nofIndices,0,vao,false);
+  pushDrawCommand (cb,6,1);
+
+  nofBunnyInvocations = 0;
+  nofBunnyFragments   = 0;
+  if(async)gpu_execute_async(mem,cb).wait();
+  else gpu_execute(mem,cb);
+
+  if(statistics)*statistics = mem.statistics;
+  return framebuffer;
+}
+
+bool sameFrames(Framebuffer const&expected,Framebuffer const&student){
+  for(uint32_t y=0;y<expected.height;++y)
+    for(uint32_t x=0;x<expected.width;++x){
+      auto pix = y*expected.width+x;
+      bool same = expected.depth.at(pix) == student.depth.at(pix);
+      for(uint32_t c=0;c<4;++c)
+        same &= expected.color.at(pix*4+c) == student.color.at(pix*4+c);
+      if(same)continue;
+      std::cerr << R".(
+    Pixel [)." << x << "," << y << R".(] se liší od sériového vykreslení.
+    sériově: barva )." << str(glm::uvec4(expected.color.at(pix*4+0),expected.color.at(pix*4+1),expected.color.at(pix*4+2),expected.color.at(pix*4+3))) << " hloubka " << expected.depth.at(pix) << R".(
+    nyní:    barva )." << str(glm::uvec4(student.color.at(pix*4+0),student.color.at(pix*4+1),student.color.at(pix*4+2),student.color.at(pix*4+3))) << " hloubka " << student.depth.at(pix) << std::endl;
+      return false;
+    }
+  return true;
+}
+
+}
+
+using namespace executionTests;
+
+SCENARIO("43"){
+  std::cerr << "43 - tiled execution should produce the same frame as serial execution" << std::endl;
+
+  GPUSettings serial;
+
+  GPUSettings tiled;
+  tiled.mode       = ExecutionMode::TILED;
+  tiled.nofThreads = 4;
+
+  auto expected = renderScene(serial,337,213);
+  auto student  = renderScene(tiled ,337,213);
+
+  if(!sameFrames(*expected,*student)){
+    std::cerr << R".(
+    Dlaždicové vykreslování (ExecutionMode::TILED) musí zpracovat trojúhelníky
+    v každé dlaždici ve stejném pořadí jako sériové vykreslování.
+    ).";
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("44"){
+  std::cerr << "44 - vertex cache should transform every unique vertex once per draw" << std::endl;
+
+  uint32_t const nofIndices = sizeof(bunnyIndices)/sizeof(VertexIndex);
+  auto const indices = &bunnyIndices[0][0];
+  auto const nofUnique = (uint32_t)std::set<VertexIndex>(indices,indices+nofIndices).size();
+
+  GPUSettings serial;
+  auto expected = renderScene(serial,200,150);
+
+  GPUSettings cached;
+  cached.vertexCache = true;
+  GPUStatistics stats;
+  auto student = renderScene(cached,200,150,&stats);
+
+  bool success = sameFrames(*expected,*student);
+  success &= nofBunnyInvocations == 2*nofUnique;
+  success &= stats.vertexCacheLookups == 2*nofIndices;
+  success &= stats.vertexCacheHits    == 2*(nofIndices-nofUnique);
+
+  if(!success){
+    std::cerr << R".(
+    Se zapnutou vertex cache (GPUSettings::vertexCache) se má vertex shader
+    indexovaného vykreslování spustit jen jednou pro každý unikátní gl_VertexID.
+    Obrázek musí zůstat stejný.
+    počet unikátních vrcholů: )." << nofUnique << R".( (2 vykreslení)
+    počet spuštění vertex shaderu: )." << nofBunnyInvocations << R".(
+    vertexCacheLookups: )." << stats.vertexCacheLookups << " (očekáváno " << 2*nofIndices << R".()
+    vertexCacheHits: )." << stats.vertexCacheHits << " (očekáváno " << 2*(nofIndices-nofUnique) << ")" << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("46"){
+  std::cerr << "46 - early depth test should skip fragment shader of occluded fragments" << std::endl;
+
+  GPUSettings serial;
+  auto expected = renderScene(serial,200,150);
+  uint32_t lateFragments = nofBunnyFragments;
+
+  auto student = renderScene(serial,200,150,nullptr,true);
+  uint32_t earlyFragments = nofBunnyFragments;
+
+  GPUSettings tiled;
+  tiled.mode       = ExecutionMode::TILED;
+  tiled.nofThreads = 4;
+  auto tiledStudent = renderScene(tiled,200,150,nullptr,true);
+
+  bool success = sameFrames(*expected,*student);
+  success &= sameFrames(*expected,*tiledStudent);
+  success &= earlyFragments < lateFragments;
+
+  if(!success){
+    std::cerr << R".(
+    S Program::earlyDepthTest se má hloubka testovat před spuštěním fragment shaderu.
+    Zakryté fragmenty fragment shader nespouští, obrázek musí zůstat stejný.
+    počet spuštění fragment shaderu bez early depth testu: )." << lateFragments << R".(
+    počet spuštění fragment shaderu s early depth testem: )." << earlyFragments << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("48"){
+  std::cerr << "48 - batched fragment shader should produce the same frame as scalar fragment shader" << std::endl;
+
+  GPUSettings serial;
+  auto expected = renderScene(serial,200,150);
+  uint32_t scalarFragments = nofBunnyFragments;
+
+  auto student = renderScene(serial,200,150,nullptr,false,true);
+  uint32_t packetFragments = nofBunnyFragments;
+
+  GPUSettings tiled;
+  tiled.mode       = ExecutionMode::TILED;
+  tiled.nofThreads = 4;
+  auto tiledStudent = renderScene(tiled,200,150,nullptr,true,true);
+
+  bool success = sameFrames(*expected,*student);
+  success &= sameFrames(*expected,*tiledStudent);
+  success &= scalarFragments == packetFragments;
+
+  if(!success){
+    std::cerr << R".(
+    S Program::fragmentPacketShader dostává fragment shader celé řádky fragmentů najednou.
+    Každý pokrytý fragment musí být zpracován právě jednou a obrázek musí zůstat stejný.
+    počet fragmentů zpracovaných skalárním shaderem: )." << scalarFragments << R".(
+    počet pokrytých fragmentů v paketech: )." << packetFragments << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("49"){
+  std::cerr << "49 - batched vertex shader should produce the same frame as scalar vertex shader" << std::endl;
+
+  GPUSettings serial;
+  auto expected = renderScene(serial,200,150);
+  uint32_t scalarInvocations = nofBunnyInvocations;
+
+  auto student = renderScene(serial,200,150,nullptr,false,false,true);
+  uint32_t packetInvocations = nofBunnyInvocations;
+
+  GPUSettings tiled;
+  tiled.mode        = ExecutionMode::TILED;
+  tiled.nofThreads  = 4;
+  tiled.vertexCache = true;
+  auto tiledStudent = renderScene(tiled,200,150,nullptr,false,false,true);
+
+  bool success = sameFrames(*expected,*student);
+  success &= sameFrames(*expected,*tiledStudent);
+  success &= scalarInvocations == packetInvocations;
+
+  if(!success){
+    std::cerr << R".(
+    S Program::vertexPacketShader dostává vertex shader celé skupiny vrcholů najednou.
+    Každý vrchol musí být zpracován právě jednou a obrázek musí zůstat stejný.
+    počet vrcholů zpracovaných skalárním shaderem: )." << scalarInvocations << R".(
+    počet platných vrcholů v paketech: )." << packetInvocations << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("52"){
+  std::cerr << "52 - pipelined execution should produce the same frame as serial execution" << std::endl;
+
+  GPUSettings serial;
+
+  GPUSettings pipelined;
+  pipelined.mode = ExecutionMode::PIPELINED;
+
+  auto expected = renderScene(serial   ,337,213);
+  auto student  = renderScene(pipelined,337,213);
+
+  GPUSettings cached = pipelined;
+  cached.vertexCache = true;
+  auto cachedStudent = renderScene(cached,337,213,nullptr,true);
+
+  bool success = sameFrames(*expected,*student);
+  success &= sameFrames(*expected,*cachedStudent);
+
+  if(!success){
+    std::cerr << R".(
+    Zřetězené vykreslování (ExecutionMode::PIPELINED) zpracovává vrcholy, primitiva
+    a rasterizaci souběžně, rasterizace ale musí zpracovat trojúhelníky i čisticí
+    příkazy ve stejném pořadí jako sériové vykreslování.
+    ).";
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("53"){
+  std::cerr << "53 - asynchronous execution should produce the same frame as serial execution and keep submission order" << std::endl;
+
+  GPUSettings serial;
+
+  GPUSettings tiled;
+  tiled.mode       = ExecutionMode::TILED;
+  tiled.nofThreads = 4;
+
+  auto expected     = renderScene(serial,337,213);
+  auto student      = renderScene(serial,337,213,nullptr,false,false,false,true);
+  auto tiledStudent = renderScene(tiled ,337,213,nullptr,false,false,false,true);
+
+  bool success = sameFrames(*expected,*student);
+  success &= sameFrames(*expected,*tiledStudent);
+
+  MEMCB();
+  auto framebuffer = std::make_shared<Framebuffer>(4,4);
+  mem.framebuffer = framebuffer->getFrame();
+  CommandBuffer second;
+  pushClearCommand(cb    ,glm::vec4(1.f,0.f,0.f,1.f));
+  pushClearCommand(second,glm::vec4(0.f,1.f,0.f,1.f));
+
+  auto firstFence  = gpu_execute_async(mem,cb    );
+  auto secondFence = gpu_execute_async(mem,second);
+  secondFence.wait();
+
+  bool ordered = firstFence.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  ordered &= framebuffer->color.at(0) == 0 && framebuffer->color.at(1) == 255;
+  success &= ordered;
+
+  if(!success){
+    std::cerr << R".(
+    Funkce gpu_execute_async odešle práci na gpu a hned se vrátí, vrácený plot (GPUFence)
+    je signalizován po dokončení. Obrázek musí být stejný jako při gpu_execute
+    a odeslané command buffery se musí vykonat v pořadí odeslání.
+    ).";
+    if(!ordered)std::cerr << "pořadí odeslání nebylo dodrženo" << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("54"){
+  std::cerr << "54 - blocked framebuffer should produce the same frame as row-major framebuffer" << std::endl;
+
+  GPUSettings serial;
+
+  auto expected = renderScene(serial,337,213);
+
+  bool success = true;
+  for(auto mode:{ExecutionMode::SERIAL,ExecutionMode::TILED,ExecutionMode::PIPELINED}){
+    GPUSettings blocked;
+    blocked.mode               = mode;
+    blocked.nofThreads         = 4;
+    blocked.blockedFramebuffer = true;
+    success &= sameFrames(*expected,*renderScene(blocked,337,213));
+  }
+
+  // frame is loaded into blocks when the command buffer does not clear it first
+  MEMCB();
+  Framebuffer framebuffer(29,13);
+  for(uint32_t i=0;i<29*13;++i){
+    for(uint32_t c=0;c<4;++c)framebuffer.color.at(i*4+c) = (uint8_t)(i*7+c);
+    framebuffer.depth.at(i) = (float)i;
+  }
+  Framebuffer const original = framebuffer;
+  mem.framebuffer = framebuffer.getFrame();
+  mem.settings.blockedFramebuffer = true;
+  gpu_execute(mem,cb);
+  success &= sameFrames(original,framebuffer);
+
+  if(!success){
+    std::cerr << R".(
+    GPUSettings::blockedFramebuffer ukládá barvu i hloubku během vykreslování po blocích 8x8 pixelů
+    a na konci gpu_execute je převede zpět po řádcích. Obrázek musí být stejný
+    jako při vykreslování přímo do řádků, i když šířka a výška nejsou násobkem 8.
+    ).";
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("55"){
+  std::cerr << "55 - fast clear should produce the same frame as clearing all pixels immediately" << std::endl;
+
+  GPUSettings serial;
+
+  auto expected = renderScene(serial,337,213);
+
+  bool success = true;
+  for(auto mode:{ExecutionMode::SERIAL,ExecutionMode::TILED,ExecutionMode::PIPELINED})
+    for(bool blockedFramebuffer:{false,true}){
+      GPUSettings fast;
+      fast.mode               = mode;
+      fast.nofThreads         = 4;
+      fast.blockedFramebuffer = blockedFramebuffer;
+      fast.fastClear          = true;
+      success &= sameFrames(*expected,*renderScene(fast,337,213,nullptr,true));
+    }
+
+  // partial clears in the middle of the command buffer, draws keep depth of the first clear
+  auto renderClears = [](bool fastClear){
+    MEMCB();
+    auto framebuffer = std::make_shared<Framebuffer>(83,45);
+    mem.framebuffer = framebuffer->getFrame();
+    mem.settings.fastClear = fastClear;
+    mem.programs[0].vertexShader   = overlayVertexShader;
+    mem.programs[0].fragmentShader = overlayFragmentShader;
+    mem.programs[0].vs2fs[0]       = AttributeType::VEC4;
+    pushClearCommand(cb,glm::vec4(.1f,.2f,.3f,1.f),.5f,true ,true );
+    pushDrawCommand (cb,6);
+    pushClearCommand(cb,glm::vec4(.9f,.8f,.7f,1.f),.5f,true ,false);
+    pushDrawCommand (cb,3);
+    pushClearCommand(cb,glm::vec4(.0f,.0f,.0f,0.f),.3f,false,true );
+    gpu_execute(mem,cb);
+    return framebuffer;
+  };
+  success &= sameFrames(*renderClears(false),*renderClears(true));
+
+  if(!success){
+    std::cerr << R".(
+    GPUSettings::fastClear si při čištění pouze označí bloky 8x8 pixelů,
+    hodnota se do bloku zapíše při prvním kreslení do něj nebo na konci gpu_execute.
+    Výsledný obrázek musí být stejný jako při okamžitém čištění celého framebufferu.
+    ).";
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("60"){
+  std::cerr << "60 - draws with different numbers of threads should not disturb each other" << std::endl;
+
+  GPUSettings serial;
+
+  auto expected = renderScene(serial,337,213);
+
+  // the submission thread and the calling thread use pools of different sizes at the same time
+  bool success = true;
+  for(uint32_t i=0;i<4;++i){
+    GPUSettings asyncSettings;
+    asyncSettings.mode       = ExecutionMode::TILED;
+    asyncSettings.nofThreads = 3;
+    GPUSettings syncSettings;
+    syncSettings.mode        = ExecutionMode::TILED;
+    syncSettings.nofThreads  = i%2 ? 2 : 0;
+
+    auto asyncRender = std::async(std::launch::async,[&](){return renderScene(asyncSettings,337,213,nullptr,false,false,false,true);});
+    auto syncFrame   = renderScene(syncSettings,337,213);
+    success &= sameFrames(*expected,*syncFrame);
+    success &= sameFrames(*expected,*asyncRender.get());
+  }
+
+  if(!success){
+    std::cerr << R".(
+    Vlákna s různým GPUSettings::nofThreads (např. gpu_execute a gpu_execute_async)
+    nesmí zrušit pool vláken, který používá jiné vlákno. Obrázky musí být stejné jako při sériovém vykreslení.
+    ).";
+    REQUIRE(false);
+  }
+}
@@ -1280,3 +1280,442 @@ SCENARIO("20"){
     REQUIRE(false);
   }
 }
+
+SCENARIO("45"){
+  std::cerr << "45 - pixels on an edge shared by two triangles should be rasterized once" << std::endl;
+
+  auto&inFragments = dumpInject.inFragments;
+  auto&outVertices = dumpInject.outVertices;
+
+  auto res = glm::uvec2(16,16);
+
+  // quad with corners in pixel centers (2.5,2.5) - (10.5,12.5), its diagonal goes through pixel center (6.5,7.5)
+  auto toNdc = [&](float x,float y){return glm::vec4(x/res.x*2.f-1.f,y/res.y*2.f-1.f,0.f,1.f);};
+
+  outVertices.clear();
+  outVertices.resize(6);
+  outVertices[0].gl_Position = toNdc( 2.5f, 2.5f);
+  outVertices[1].gl_Position = toNdc(10.5f, 2.5f);
+  outVertices[2].gl_Position = toNdc(10.5f,12.5f);
+  outVertices[3].gl_Position = toNdc( 2.5f, 2.5f);
+  outVertices[4].gl_Position = toNdc(10.5f,12.5f);
+  outVertices[5].gl_Position = toNdc( 2.5f,12.5f);
+
+  inFragments.clear();
+
+  MEMCB();
+
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  mem.framebuffer = framebuffer->getFrame();
+  mem.programs[0].vertexShader   = vertexShaderInject;
+  mem.programs[0].fragmentShader = fragmentShaderDump;
+
+  pushDrawCommand(cb,(uint32_t)outVertices.size());
+
+  gpu_execute(mem,cb);
+
+  std::map<UV2,uint32_t>counts;
+  for(auto const&f:inFragments)
+    counts[UV2(glm::uvec2(f.gl_FragCoord))]++;
+
+  // left and top edges belong to the quad, right and bottom edges do not
+  bool success = inFragments.size() == 8*10;
+  for(auto const&c:counts){
+    success &= c.second == 1;
+    success &= c.first.data.x >= 2 && c.first.data.x < 10;
+    success &= c.first.data.y >= 3 && c.first.data.y < 13;
+  }
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje pravidlo vyplňování (top-left fill rule).
+    Čtverec z pixelových středů (2.5,2.5) - (10.5,12.5) je složen ze dvou trojúhelníků
+    se společnou úhlopříčkou, která prochází středem pixelu (6.5,7.5).
+
+    Každý pixel čtverce musí být vyrasterizován právě jednou,
+    pixely ležící na levé a horní hraně patří čtverci, pixely na pravé a spodní hraně ne.
+
+    počet vyrasterizovaných fragmentů: )."<<inFragments.size()<<R".(
+    očekávaný počet fragmentů: )."<<8*10<<std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("51"){
+  std::cerr << "51 - mesh of subpixel triangles should rasterize every covered pixel once" << std::endl;
+
+  auto&inFragments = dumpInject.inFragments;
+  auto&outVertices = dumpInject.outVertices;
+
+  auto res = glm::uvec2(16,16);
+
+  // square (2,2) - (14,14) split into 16x16 cells of 0.75 pixel, every cell is split into two triangles
+  auto toNdc = [&](float x,float y){return glm::vec4(x/res.x*2.f-1.f,y/res.y*2.f-1.f,0.f,1.f);};
+  uint32_t const cells = 16;
+  float    const cell  = 0.75f;
+
+  outVertices.clear();
+  for(uint32_t j=0;j<cells;++j)
+    for(uint32_t i=0;i<cells;++i){
+      float x0 = 2.f+cell*i,x1 = x0+cell;
+      float y0 = 2.f+cell*j,y1 = y0+cell;
+      outVertices.push_back({{},toNdc(x0,y0)});
+      outVertices.push_back({{},toNdc(x1,y0)});
+      outVertices.push_back({{},toNdc(x1,y1)});
+      outVertices.push_back({{},toNdc(x0,y0)});
+      outVertices.push_back({{},toNdc(x1,y1)});
+      outVertices.push_back({{},toNdc(x0,y1)});
+    }
+
+  inFragments.clear();
+
+  MEMCB();
+
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  mem.framebuffer = framebuffer->getFrame();
+  mem.programs[0].vertexShader   = vertexShaderInject;
+  mem.programs[0].fragmentShader = fragmentShaderDump;
+
+  pushDrawCommand(cb,(uint32_t)outVertices.size());
+
+  gpu_execute(mem,cb);
+
+  std::map<UV2,uint32_t>counts;
+  for(auto const&f:inFragments)
+    counts[UV2(glm::uvec2(f.gl_FragCoord))]++;
+
+  bool success = inFragments.size() == 12*12;
+  for(auto const&c:counts){
+    success &= c.second == 1;
+    success &= c.first.data.x >= 2 && c.first.data.x < 14;
+    success &= c.first.data.y >= 2 && c.first.data.y < 14;
+  }
+
+  if(!success){
+    std::cerr << R".(
+    Čtverec (2,2) - (14,14) je složen z 512 trojúhelníků menších než pixel.
+    Většina z nich neobsahuje žádný střed pixelu, ostatní pokrývají jeden nebo dva.
+    Každý pixel čtverce musí být vyrasterizován právě jednou.
+
+    počet vyrasterizovaných fragmentů: )."<<inFragments.size()<<R".(
+    očekávaný počet fragmentů: )."<<12*12<<std::endl;
+    REQUIRE(false);
+  }
+}
+
+void fragmentPacketShaderColor(OutFragmentPacket&outPacket,InFragmentPacket const&inPacket,ShaderInterface const&){
+  for(uint32_t c=0;c<4;++c)
+    for(uint32_t i=0;i<fragmentPacketSize;++i)
+      outPacket.gl_FragColor[c][i] = inPacket.attributes[0].v[c][i];
+}
+
+SCENARIO("56"){
+  std::cerr << "56 - blend modes" << std::endl;
+
+  auto&outVertices = dumpInject.outVertices;
+
+  auto res = glm::uvec2(37,21);
+
+  auto color      = glm::vec4(.3f,.4f,.2f,.7f);
+  auto frameColor = glm::vec4(.5f,.3f,.2f,1.f);
+
+  outVertices.clear();
+  outVertices.resize(3);
+  outVertices[0].gl_Position = glm::vec4(-1,-1,0,1);
+  outVertices[1].gl_Position = glm::vec4(+4,-1,0,1);
+  outVertices[2].gl_Position = glm::vec4(-1,+4,0,1);
+  for(auto&v:outVertices)v.attributes[0].v4 = color;
+
+  auto render = [&](BlendMode blendMode,bool packetShader){
+    MEMCB();
+    auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+    mem.framebuffer = framebuffer->getFrame();
+    mem.programs[0].vertexShader   = vertexShaderInject;
+    mem.programs[0].fragmentShader = fragmentShaderDepthTest;
+    mem.programs[0].vs2fs[0]       = AttributeType::VEC4;
+    if(packetShader)mem.programs[0].fragmentPacketShader = fragmentPacketShaderColor;
+    pushClearCommand(cb,frameColor);
+    pushDrawCommand(cb,3);
+    cb.commands[1].data.drawCommand.blendMode = blendMode;
+    gpu_execute(mem,cb);
+    return framebuffer;
+  };
+
+  auto frame = glm::uvec4(frameColor*255.f);
+  auto src   = glm::uvec4(color*255.f);
+  uint32_t inverseAlpha = 255 - (uint32_t)(color.a*255.f+.5f);
+
+  glm::uvec4 expected[3];
+  expected[(uint32_t)BlendMode::ALPHA        ] = glm::uvec4(alphaMix(frameColor,color),0);
+  expected[(uint32_t)BlendMode::DISABLED     ] = glm::uvec4(glm::uvec3(src),0);
+  expected[(uint32_t)BlendMode::PREMULTIPLIED] = glm::uvec4(glm::uvec3(src),0);
+  for(uint32_t c=0;c<3;++c)
+    expected[(uint32_t)BlendMode::PREMULTIPLIED][c] += (uint32_t)std::lround(frame[c]*inverseAlpha/255.);
+
+  bool success = true;
+  glm::uvec3 wrongColor;
+  BlendMode  wrongMode = BlendMode::ALPHA;
+  for(auto blendMode:{BlendMode::ALPHA,BlendMode::DISABLED,BlendMode::PREMULTIPLIED}){
+    auto scalar = render(blendMode,false);
+    auto packet = render(blendMode,true );
+    success &= scalar->color == packet->color;
+    auto finalColor = readColor(scalar->getFrame(),glm::uvec2(res.x/2,res.y/2));
+    if(finalColor != glm::uvec3(expected[(uint32_t)blendMode])){
+      success    = false;
+      wrongColor = finalColor;
+      wrongMode  = blendMode;
+    }
+  }
+
+  if(!success){
+    std::cerr << R".(
+    DrawCommand::blendMode určuje, jak se barva fragmentu smíchá s barvou ve framebufferu.
+    ALPHA         - barva = fragment*alpha + framebuffer*(1-alpha)
+    DISABLED      - barva fragmentu přepíše framebuffer
+    PREMULTIPLIED - barva = fragment + framebuffer*(1-alpha), fragment je již vynásoben alphou
+    Skalární i paketový fragment shader musí dát stejný výsledek.
+
+    mód: )." << (uint32_t)wrongMode << R".(
+    výsledná barva: )." << str(wrongColor) << R".(
+    očekávaná barva: )." << str(glm::uvec3(expected[(uint32_t)wrongMode])) << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("57"){
+  std::cerr << "57 - derivatives of texture coordinates and mipmapping" << std::endl;
+
+  auto&inFragments = dumpInject.inFragments;
+  auto&outVertices = dumpInject.outVertices;
+
+  auto res = glm::uvec2(16,16);
+
+  // uv = (x/4, y/8) in screen space, w is constant, so derivatives are constant too
+  outVertices.clear();
+  outVertices.resize(3);
+  outVertices[0].gl_Position = glm::vec4(-2,-2,0,2);
+  outVertices[1].gl_Position = glm::vec4(+6,-2,0,2);
+  outVertices[2].gl_Position = glm::vec4(-2,+6,0,2);
+  outVertices[0].attributes[0].v2 = glm::vec2(0.f,0.f);
+  outVertices[1].attributes[0].v2 = glm::vec2(8.f,0.f);
+  outVertices[2].attributes[0].v2 = glm::vec2(0.f,4.f);
+
+  inFragments.clear();
+
+  MEMCB();
+
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  mem.framebuffer = framebuffer->getFrame();
+  mem.programs[0].vertexShader        = vertexShaderInject;
+  mem.programs[0].fragmentShader      = fragmentShaderDump;
+  mem.programs[0].vs2fs[0]            = AttributeType::VEC2;
+  mem.programs[0].derivativeAttribute = 0;
+
+  pushDrawCommand(cb,3);
+
+  gpu_execute(mem,cb);
+
+  bool success = inFragments.size() == res.x*res.y;
+  InFragment wrong;
+  for(auto const&f:inFragments){
+    bool ok = true;
+    ok &= glm::all(glm::lessThan(glm::abs(glm::vec2(f.dFdx)-glm::vec2(.25f,0.f  )),glm::vec2(1e-4f)));
+    ok &= glm::all(glm::lessThan(glm::abs(glm::vec2(f.dFdy)-glm::vec2(0.f  ,.125f)),glm::vec2(1e-4f)));
+    if(!ok)wrong = f;
+    success &= ok;
+  }
+
+  // 4x2 texture with one channel
+  uint8_t data[] = {
+    0  ,40 ,80 ,120,
+    200,240,4  ,8  ,
+  };
+  Texture texture = {data,4,2,1};
+  auto storage = generate_mipmaps(texture);
+
+  success &= texture.nofLevels == 3;
+  success &= storage.size() == 8+2+1;
+  success &= texture.data == storage.data() && std::equal(data,data+8,storage.data());
+  success &= storage[8] == 120 && storage[9] == 53;
+  success &= storage[10] == 87;
+
+  auto uv = glm::vec2(.3f,.7f);
+  uint32_t const levelOffsets[] = {0,8,10};
+  auto level = [&](uint32_t l){return glm::vec4(glm::vec3(storage[levelOffsets[l]]/255.f,0.f,0.f),1.f);};
+  success &= read_texture(texture,uv,glm::vec2(0.f),glm::vec2(0.f)) == read_texture(texture,uv);
+  success &= glm::all(glm::lessThan(glm::abs(read_texture(texture,uv,glm::vec2(.5f,0.f),glm::vec2(0.f))-level(1)),glm::vec4(1e-6f)));
+  success &= glm::all(glm::lessThan(glm::abs(read_texture(texture,uv,glm::vec2(0.f),glm::vec2(0.f,100.f))-level(2)),glm::vec4(1e-6f)));
+
+  if(!success){
+    std::cerr << R".(
+    Program::derivativeAttribute určuje atribut, jehož derivace podle x a y obrazovky dostává fragment shader v InFragment::dFdx a InFragment::dFdy.
+    Texturovací souřadnice uv = (x/4, y/8) mají derivace dFdx = (0.25, 0) a dFdy = (0, 0.125).
+    generate_mipmaps vytvoří úrovně průměrováním 2x2 texelů předchozí úrovně.
+    read_texture s derivacemi čte úroveň, jejíž texel odpovídá velikosti pixelu, s nulovými derivacemi čte základní úroveň.
+
+    počet fragmentů: )." << inFragments.size() << R".(
+    dFdx: )." << str(glm::vec2(wrong.dFdx)) << R".(
+    dFdy: )." << str(glm::vec2(wrong.dFdy)) << R".(
+    počet úrovní: )." << texture.nofLevels << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("58"){
+  std::cerr << "58 - tiled textures sampled with filters and wrap modes" << std::endl;
+
+  auto wrapTexel = [](TextureWrap wrap,int x,int size){
+    switch(wrap){
+      case TextureWrap::REPEAT       :return ((x%size)+size)%size;
+      case TextureWrap::CLAMP_TO_EDGE:return glm::clamp(x,0,size-1);
+      default:break;
+    }
+    int m = ((x%(2*size))+2*size)%(2*size);
+    return m<size?m:2*size-1-m;
+  };
+
+  // reference sampling of row major data, levels follow each other
+  auto reference = [&](Texture const&tex,TextureFilter filter,uint32_t level,glm::vec2 uv){
+    uint8_t const*data = tex.data;
+    for(uint32_t l=0;l<level;++l)data += glm::max(tex.width>>l,1u)*glm::max(tex.height>>l,1u)*tex.channels;
+    int w = glm::max(tex.width >>level,1u);
+    int h = glm::max(tex.height>>level,1u);
+    auto texel = [&](int x,int y){
+      x = wrapTexel(tex.wrapS,x,w);
+      y = wrapTexel(tex.wrapT,y,h);
+      glm::vec4 c = glm::vec4(0.f,0.f,0.f,1.f);
+      for(uint32_t k=0;k<tex.channels;++k)c[k] = data[(y*w+x)*tex.channels+k]/255.f;
+      return c;
+    };
+    if(filter == TextureFilter::NEAREST)
+      return texel((int)std::floor(uv.x*w),(int)std::floor(uv.y*h));
+    glm::vec2 st = uv*glm::vec2(w,h)-.5f;
+    glm::vec2 s0 = glm::floor(st);
+    glm::vec2 f  = st-s0;
+    int x = (int)s0.x,y = (int)s0.y;
+    return glm::mix(glm::mix(texel(x,y  ),texel(x+1,y  ),f.x),
+                    glm::mix(texel(x,y+1),texel(x+1,y+1),f.x),f.y);
+  };
+
+  bool success = true;
+  std::string wrong;
+  for(auto size:{glm::uvec2(5,3),glm::uvec2(4,4)}){
+    std::vector<uint8_t>data(size.x*size.y*3);
+    for(size_t i=0;i<data.size();++i)data[i] = (uint8_t)(i*37+11);
+
+    Texture tex = {data.data(),size.x,size.y,3};
+    auto mipmaps = generate_mipmaps(tex);
+
+    auto uv = glm::vec2(.3f,.7f);
+    success &= sample_texture(tex,uv,glm::vec2(0.f),glm::vec2(0.f)) == read_texture(tex,uv);
+
+    auto tiles = tile_texture(tex);
+    success &= tex.texels == tiles.data();
+
+    auto const wraps = {TextureWrap::REPEAT,TextureWrap::CLAMP_TO_EDGE,TextureWrap::MIRRORED_REPEAT};
+    for(auto magFilter:{TextureFilter::NEAREST,TextureFilter::LINEAR})
+      for(auto minFilter:{TextureFilter::NEAREST,TextureFilter::LINEAR})
+        for(auto wrapS:wraps)
+          for(auto wrapT:wraps)
+            for(auto uv:{glm::vec2(-1.3f,2.7f),glm::vec2(.1f,.9f),glm::vec2(.55f,-.2f),glm::vec2(3.49f,-2.01f)})
+              for(uint32_t level:{0u,1u}){
+                tex.magFilter = magFilter;
+                tex.minFilter = minFilter;
+                tex.wrapS     = wrapS;
+                tex.wrapT     = wrapT;
+                // a pixel of two texels is minified and reads level 1, no derivatives magnify level 0
+                auto derivative = glm::vec2(level*2.f/size.x,0.f);
+                auto filter     = level?minFilter:magFilter;
+                auto color    = sample_texture(tex,uv,derivative,glm::vec2(0.f));
+                auto expected = reference(tex,filter,level,uv);
+                if(glm::any(glm::greaterThan(glm::abs(color-expected),glm::vec4(1e-4f)))){
+                  success = false;
+                  wrong = "velikost: "+str(size)+" filtr: "+str((uint32_t)filter)+" wrap: "+str((uint32_t)wrapS)+", "+str((uint32_t)wrapT)+" úroveň: "+str(level)+" uv: "+str(uv)+
+                          "\n    barva: "+str(color)+"\n    očekávaná barva: "+str(expected);
+                }
+              }
+  }
+
+  if(!success){
+    std::cerr << R".(
+    tile_texture uloží všechny úrovně textury do dlaždic 4x4 texelů RGBA8.
+    sample_texture čte dlaždicovou texturu podle Texture::magFilter, při zmenšení (pixel větší než texel) podle Texture::minFilter (NEAREST, LINEAR),
+    souřadnici u opakuje podle Texture::wrapS a v podle Texture::wrapT (REPEAT, CLAMP_TO_EDGE, MIRRORED_REPEAT),
+    středy texelů leží v ((i+0.5)/width, (j+0.5)/height).
+    Textura bez dlaždic se čte pomocí read_texture.
+
+    )." << wrong << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("59"){
+  std::cerr << "59 - block compressed textures" << std::endl;
+
+  bool success = true;
+  std::string wrong;
+
+  // color representable in RGB565 is stored exactly
+  std::vector<uint8_t>solid(6*5*3);
+  for(size_t i=0;i<solid.size();i+=3){solid[i+0] = 165;solid[i+1] = 162;solid[i+2] = 74;}
+  Texture solidTexture = {solid.data(),6,5,3};
+  auto solidMipmaps = generate_mipmaps(solidTexture);
+  auto solidBlocks  = compress_texture(solidTexture);
+  success &= solidTexture.format == TextureFormat::BC1;
+  success &= solidTexture.texels == solidBlocks.data();
+  success &= solidBlocks.size() == (2*2+1+1)*2;
+  solidTexture.magFilter = TextureFilter::NEAREST;
+  auto solidColor = sample_texture(solidTexture,glm::vec2(.9f,.1f),glm::vec2(0.f),glm::vec2(0.f));
+  success &= glm::uvec4(solidColor*255.f+.5f) == glm::uvec4(165,162,74,255);
+  if(!success)wrong = "jednobarevná textura: "+str(solidColor);
+
+  // colors change along x, red and green go against each other, alpha changes along y
+  glm::uvec2 size = glm::uvec2(16,8);
+  std::vector<uint8_t>data(size.x*size.y*4);
+  for(uint32_t y=0;y<size.y;++y)
+    for(uint32_t x=0;x<size.x;++x){
+      uint8_t*t = data.data()+(y*size.x+x)*4;
+      t[0] = (uint8_t)(x*16);
+      t[1] = (uint8_t)(255-x*16);
+      t[2] = (uint8_t)(x*8);
+      t[3] = (uint8_t)(255-y*20);
+    }
+
+  // the same colors without alpha
+  std::vector<uint8_t>rgb;
+  for(size_t i=0;i<data.size();i+=4)rgb.insert(rgb.end(),data.begin()+i,data.begin()+i+3);
+
+  for(auto format:{TextureFormat::BC1,TextureFormat::BC3}){
+    Texture tiled = format == TextureFormat::BC1?Texture{rgb.data(),size.x,size.y,3}:Texture{data.data(),size.x,size.y,4};
+    auto mipmaps = generate_mipmaps(tiled);
+    Texture compressed = tiled;
+    auto tiles  = tile_texture(tiled);
+    auto blocks = compress_texture(compressed);
+
+    success &= compressed.format == format;
+    success &= blocks.size()*(format == TextureFormat::BC1?8:4) == tiles.size();
+
+    tiled     .magFilter = TextureFilter::NEAREST;
+    compressed.magFilter = TextureFilter::NEAREST;
+    for(uint32_t y=0;y<size.y;++y)
+      for(uint32_t x=0;x<size.x;++x){
+        auto uv       = (glm::vec2(x,y)+.5f)/glm::vec2(size);
+        auto expected = sample_texture(tiled     ,uv,glm::vec2(0.f),glm::vec2(0.f));
+        auto color    = sample_texture(compressed,uv,glm::vec2(0.f),glm::vec2(0.f));
+        if(glm::any(glm::greaterThan(glm::abs(color-expected),glm::vec4(12.f/255.f)))){
+          success = false;
+          wrong = "formát: "+str((uint32_t)format)+" texel: "+str(glm::uvec2(x,y))+"\n    barva: "+str(color)+"\n    očekávaná barva: "+str(expected);
+        }
+      }
+  }
+
+  if(!success){
+    std::cerr << R".(
+    compress_texture zakóduje všechny úrovně textury do bloků 4x4 texelů,
+    neprůhledné textury do BC1 (8 bytů na blok), textury s alphou do BC3 (16 bytů na blok).
+    sample_texture bloky dekóduje při čtení, barva se smí od původní lišit nejvýše o 12/255.
+
+    )." << wrong << std::endl;
+    REQUIRE(false);
+  }
+}
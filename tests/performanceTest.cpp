@@ -53,4 +53,13 @@ void runPerformanceTest(size_t framesPerMeasurement) {
   std::cout << "Seconds per frame: " << std::scientific << std::setprecision(10)
             << time << std::endl;
 
+  auto const&stats = method->mem.statistics;
+  if(stats.vertexCacheLookups > 0)
+    std::cout << "Vertex cache hit rate: " << std::fixed << std::setprecision(4)
+              << (double)stats.vertexCacheHits / (double)stats.vertexCacheLookups << std::endl;
+  if(method->mem.settings.mode == ExecutionMode::PIPELINED)
+    std::cout << "Pipeline queue waits (full/empty): vertex "
+              << stats.vertexQueueFullWaits   << "/" << stats.vertexQueueEmptyWaits   << ", triangle "
+              << stats.triangleQueueFullWaits << "/" << stats.triangleQueueEmptyWaits << std::endl;
+
 }